@@ -0,0 +1,38 @@
+#ifndef BLOCKLANG_ACTORS_H
+#define BLOCKLANG_ACTORS_H 1
+
+#include "definitions.h"
+
+/*
+    Actor mode, for runs where only the data that comes out matters
+
+    run_grid_actors drops the ticks altogether. Every block with a program is an actor that runs its instructions back
+    to back until a transfer with a neighbour has to wait, it halts or it has run max_steps + 1 instructions (as many as
+    max_ticks would allow it). A transfer between neighbours is a handoff: whichever side gets there first leaves an
+    offer and blocks, the other one completes it and puts the first back in the queue. Slots, failures and ANY work as
+    they do in two-phase ticks (see grid.two_phase); WAIT only takes its operand.
+
+    Actors are run by a pool of threads, each with its own deque. A thread pushes the actors it wakes onto its own
+    deque and runs from the bottom of it, and once that is empty takes from the top of another thread's. An actor that
+    keeps running gets back in line every ACTORS_SLICE instructions so others get to run as well.
+
+    What comes out of a program that does not depend on timing (a pipeline that only ever waits on its transfers) is the
+    same as with run_grid, and test_app checks that for a config with "actors" set that runs to the end. The status is
+    GRID_TICK_LIMIT if any actor ran out of steps, GRID_DEADLOCK if any is still blocked, GRID_IDLE otherwise, and
+    grid.ticks moves on by the most instructions any actor ran. A grid in which blocks share a self-modifying program is
+    run on one thread.
+*/
+
+#define ACTORS_MAX_THREADS 64
+#define ACTORS_SLICE 4096
+
+// interpreter pieces the actors share with the tick loop, see vm.c
+side get_opposite_side(side val);
+bool can_read(io_slot *slot);
+u8 read_byte(io_slot *slot);
+bool block_write_to_slot(io_slot *slot, u8 value);
+const decoded_instruction *block_fetch_current(block *b);
+void block_exec_local(grid *g, block *b, u8 x, u8 y, const decoded_instruction *d);
+void block_finish_transfer(block *b, const decoded_instruction *d, u8 result, u8 value);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef BLOCKLANG_ANALYSIS_H
+#define BLOCKLANG_ANALYSIS_H 1
+
+#include "definitions.h"
+
+/*
+    Abstract interpretation of block programs
+
+    Runs a program from the state load_program leaves a block in (address 0, empty stack, ACC and registers zero) with
+    every transfer delivering an unknown value, and records what holds at each address it can reach: the stack depth range, which of ACC and the registers have one known value, and whether
+    last_caused_overflow can still be read by a JOF. Blocked transfers are taken into account (they repeat their
+    instruction, stack effects included), as are the clamps and jumps to computed addresses, so the facts hold for
+    every run.
+
+    Programs that write to their own bytecode get nothing better than "anything goes" at every address.
+
+    load_program keeps the sides in block.sides_used so run_grid can tell which blocks can reach an output slot, and
+    the ahead-of-time translator in native.h uses the rest to leave out stack checks and
+    overflow flags nothing reads and to fold known values into the generated code.
+*/
+
+enum
+{
+    FACT_ACC,
+    FACT_RG0,
+    FACT_RG1,
+    FACT_RG2,
+    FACT_RG3,
+    FACT_VALUES
+};
+
+#define SIDES_ALL ((1 << up) | (1 << right) | (1 << down) | (1 << left) | (1 << any))
+
+// what holds whenever the block is about to run the instruction at an address
+typedef struct
+{
+    bool reachable;
+    u8 stack_min, stack_max; // stack depth
+    u8 known;                // bit FACT_x is set if value[FACT_x] is the only value ACC or that register can hold
+    u8 value[FACT_VALUES];
+    bool overflow_live;     // last_caused_overflow as it is now may still be read
+    bool overflow_live_out; // what the instruction leaves in last_caused_overflow may still be read
+} pc_facts;
+
+typedef struct
+{
+    bool exact; // false for self-modifying programs, every address then has the weakest facts
+    u8 sides;   // 1 << side for every side (any included) a reachable instruction names as its target
+    pc_facts pc[256];
+} program_facts;
+
+void analyze_program(const u8 *bytecode, u8 length, program_facts *out);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef BLOCKLANG_BATCH_H
+#define BLOCKLANG_BATCH_H 1
+
+#include "definitions.h"
+
+/*
+    One grid run against many inputs
+
+    run_grid_batch takes a grid that is set up (programs loaded, slots attached) and runs a copy of it for every
+    record: fill puts the inputs of the record into the copy, run_grid runs it, and collect reads out what the record
+    needs. The template itself is left alone.
+
+    Records are run on a pool of threads, the calling thread included, each taking the next record as it gets done
+    with one. Every thread copies the template into the one grid it keeps for the whole batch, so nothing is assembled
+    or allocated per record and the JIT code of a program is built once per thread (see copy_grid). Blocks running a
+    self-modifying program get a copy of it per thread, fresh for every record, so records cannot see each other's
+    writes.
+
+    fill and collect run on the thread that runs the record, at the same time as those of other records. Writing the
+    results to storage indexed by record keeps them in input order whichever thread finishes first.
+*/
+
+#define BATCH_MAX_THREADS 64
+
+typedef void (*batch_fill_fn)(grid *g, u32 record, void *context);
+typedef void (*batch_collect_fn)(const grid *g, u32 record, grid_status status, void *context);
+
+void run_grid_batch(const grid *template, u32 records, u32 max_ticks, int threads, batch_fill_fn fill,
+                    batch_collect_fn collect, void *context);
+
+#endif
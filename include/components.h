@@ -0,0 +1,28 @@
+#ifndef BLOCKLANG_COMPONENTS_H
+#define BLOCKLANG_COMPONENTS_H 1
+
+#include "definitions.h"
+
+/*
+    Independent parts of a grid
+
+    A block only ever looks at a neighbour on a side its program names (any names all four), and only touches the edge
+    slots next to it. Blocks running the same self-modifying program also see each other's writes. Joining every block
+    with program to the neighbours with a program its block.sides_used leads to, and to the blocks sharing its bytecode
+    if it writes to it, splits the grid into components that cannot tell whether the others exist.
+
+    run_grid_components runs each component as a grid of its own on a pool of threads, every one in the usual
+    row-major order, and merges the outcomes back: the tick count is the highest any component reached, the status
+    GRID_TICK_LIMIT if any component ran into max_ticks, otherwise GRID_DEADLOCK if any deadlocked, otherwise
+    GRID_IDLE. Blocks, slots and the live list end up exactly where run_grid leaves them.
+
+    Compiled grids and runs with grid.checkpoints go through run_grid as a whole.
+*/
+
+#define COMPONENTS_MAX_THREADS 64
+
+// component of every block numbered from 1 in row-major order of their first block, 0 for blocks without a program.
+// returns how many there are
+u16 grid_find_components(const grid *g, u16 *component);
+
+#endif
@@ -44,6 +44,16 @@ typedef struct
     bool debug;
     u32 ticks_limit;
     bool print_strings;
+    bool jit;
+    bool fuse;     // run common instruction sequences as superinstructions, see grid.fuse
+    bool trace;    // record hot loops and run them along the recorded trace, see grid.trace
+    bool batch;    // run local instructions ahead in batches, see grid.batch
+    bool cycles;   // skip the rounds of a grid that repeats its state, see grid.cycles
+    bool prune;    // leave out the blocks that cannot reach an output slot, see grid.prune
+    bool compiled; // build the whole grid into one native tick function next to the config file
+    bool two_phase; // see grid.two_phase
+    u8 threads;     // for the independent parts of the layout (components.h), the actors or a batch (batch.h)
+    bool actors;    // run the blocks as actors and check the outputs against run_grid, see actors.h
 } vm_config;
 
 bool parse_config(const char *filename, vm_config *config);
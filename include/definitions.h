@@ -3,6 +3,7 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 typedef unsigned char u8;
 typedef unsigned short u16;
@@ -107,6 +108,62 @@ static_assert(sizeof(instruction) == 1, "");
 
 #define BYTECODE_LIMIT (u8) - 1
 
+// flags of a decoded instruction
+enum
+{
+    DECODED_VALID = 1 << 0,   // entry matches the bytecode under it, otherwise it is decoded again before use
+    DECODED_IO = 1 << 1,      // target is a side, operand goes through block/slot transfers
+    DECODED_WRITING = 1 << 2, // PUT and POP, operand is written to the target instead of read from it
+};
+
+/*
+    instruction together with everything the interpreter would otherwise re-derive from the bytecode each tick
+
+    built for the whole program by load_program, entries are dropped when bytes under them are written through REF or
+    ADJ and decoded again the next time they are executed
+*/
+typedef struct
+{
+    u8 operation : 4;
+    u8 target : 4;
+    u8 immediate;  // ADJ operand, located after the EXT opcode for extended ops
+    u8 ext_opcode; // EXT only
+    u8 length;     // 1 to 3 bytes, the pc moves by this much if no jump happens
+    u8 side;       // transfer side, invalid if no block interactions needed
+    u8 flags;
+    u8 fused; // if 2 or more, this many instructions starting here make up a superinstruction
+} decoded_instruction;
+
+#define TRACE_MAX 64 // instructions in a recorded loop
+
+enum
+{
+    TRACE_IDLE,      // counting backward jumps
+    TRACE_RECORDING, // following the loop that got hot
+    TRACE_READY,     // replayed whenever the block is on it
+};
+
+/*
+    hot loop of a block, recorded as the addresses it went through from the target of a backward jump until it got
+    back there, see block_trace_step
+*/
+typedef struct
+{
+    u8 state;
+    u8 heat;   // backward jumps seen while idle
+    u8 misses; // guard failures since the trace was recorded
+    u8 anchor; // loop head, pcs[0] once recorded
+    u8 length;
+    u8 at; // where in pcs the block is expected to be
+    u8 pcs[TRACE_MAX];
+} block_trace;
+
+struct block_jit;
+struct block_native;
+struct grid_native;
+struct grid_history;
+struct grid_pool;
+
 typedef struct
 {
     const instruction *bytecode; // reference to a program in bytecode somewhere in teh code
@@ -124,8 +181,32 @@ typedef struct
 
     bool io_blocked;    // set when an io operation is required, but the other block is valid but not ready
     bool state_halted;
+    bool parked;        // blocked on a neighbour, skipped by the tick loop until that neighbour changes
+    u8 watchers;        // 1 << side for every neighbour parked on this block
+    bool pruned;        // cannot affect any output slot, left out of the live list, see grid.prune
 
     u8 last_caused_overflow; // for arithmetic overflows/underflows
+
+    bool self_modifying; // program contains REF or ADJ writes
+    bool verified;       // passed verify_program, runs without the checks it made redundant
+    u8 sides_used;       // 1 << side for every side the program can transfer through, see analysis.h
+    bool fusable;        // superinstructions are safe to run, decided by run_grid
+    u8 fused_ticks;      // ticks still owed by a superinstruction that already ran
+    u8 fused_resume;     // where the block continues once they are paid
+    bool traceable;      // hot loops may be recorded and replayed, same conditions as fusable
+    bool batchable;      // runs local instructions ahead in batches instead of the two above, same conditions
+
+    block_trace trace;
+
+    struct block_jit *jit;       // native code for the program, see jit.h
+    struct block_native *native; // program translated ahead of time, see native.h
+
+    decoded_instruction decoded[256]; // indexed by the address of the first byte of an instruction
+
+    // bit pc of names_side[s] is set if the byte at pc has side s as its target, bit pc of writing if it is a PUT or
+    // POP. neighbours match transfers against these instead of looking at the instruction
+    u64 names_side[4][4];
+    u64 writing[4];
 } block;
 
 typedef struct
@@ -134,8 +215,49 @@ typedef struct
     u8 len;
     u8 cur;
     bool read_only; // if set to true, can be only readed from - no pushing
+    bool ended;     // a transfer found it at its end since the run started, see history.h
 } io_slot;
 
+// what each side of a block leads to, NULL where there is no neighbour or no edge slot
+typedef struct
+{
+    block *neighbour[4];
+    io_slot *slot[4];
+} block_links;
+
+// block that still has something to run, with its position so the tick loop does not have to work it out
+typedef struct
+{
+    u8 index, x, y;
+} live_block;
+
+// what a block posted in the first half of a two-phase tick, see grid.two_phase
+enum
+{
+    INTENT_ABSENT, // no program or halted, transfers with it fail
+    INTENT_LOCAL,  // waiting or running an instruction that names no side
+    INTENT_READ,
+    INTENT_WRITE,
+};
+
+// how a transfer with a neighbour or slot came out in a two-phase tick or an actor handoff
+enum
+{
+    TRANSFER_DONE,
+    TRANSFER_BLOCKED,
+    TRANSFER_FAILED,
+};
+
+typedef struct
+{
+    u8 kind;
+    u8 side;  // of a transfer
+    u8 value; // of a write
+    bool stores; // set in the second half by a PUT or POP through REF or ADJ, the byte lands after every block ran
+    u8 store_value;
+    u16 store_addr;
+} block_intent;
+
 typedef struct
 {
     block blocks[256];
@@ -143,10 +265,37 @@ typedef struct
     u8 width, height, perimeter, total_blocks;
     bool any_ticked;
     bool debug;
+    bool fuse; // run common instruction sequences as superinstructions, results stay the same
+    bool jit;  // translate programs to native code where the host supports it, results stay the same
+    bool trace; // record hot loops and run them in batches, results stay the same
+    bool batch; // run local instructions ahead as far as the tick limit allows, replaces fuse and trace, results stay the same
+    bool cycles; // look for the grid repeating a state and skip the periods it would go round, results stay the same
+    bool prune;  // leave out blocks that cannot affect any output slot, only their own state differs, see print_pruned
+    bool checkpoints; // keep checkpoints of every run so rerun_grid can redo it with changed inputs, see history.h
+    bool two_phase;   // every block posts what it is about to do before any of them does it, results differ, see vm.c
     u32 ticks;
+    u32 max_ticks; // limit of the current run_grid call
+
+    // blocks with a program that have not halted, in row-major order. halted ones are dropped as the tick loop passes
+    // them, load_program marks the list dirty and run_grid collects it again
+    live_block live[256];
+    u16 live_count;
+    u16 parked_count; // live blocks that are parked, all of them means nothing can ever change again
+    bool live_dirty;
+    u8 soonest_wake; // ticks until a live block runs again after the last tick, 0 if one runs in the next one
+
+    block_links links[256]; // indexed like blocks, built once by initialize_grid since the size never changes
+    block_intent intents[256]; // indexed like blocks, for two-phase ticks
+
+    struct grid_native *native; // compiled tick for the whole grid, see native.h
+    struct grid_history *history; // checkpoints of the last run, see history.h
+    struct grid_pool *pool;       // threads running the current run_grid_parallel, see parallel.h
 } grid;
 
 grid *initialize_grid(u8 w, u8 h);
+// dst, a grid of the same size, becomes src as it is. the programs are shared, compiled code is not: blocks of dst
+// keep the JIT code they have if they run the same program as before and it never writes to itself
+void copy_grid(grid *dst, const grid *src);
 
 u16 io_slot_offset(const grid *g, const u8 side, const u8 slot);
 
@@ -155,9 +304,41 @@ u8* attach_input(grid *g, u8 side, u8 slot);
 u8* attach_output(grid *g, u8 side, u8 slot);
 void load_program(grid *g, u8 x, u8 y, const void *bytecode, u8 length);
 
-void run_grid(grid *g, u32 max_ticks);
+block *grid_step_block(grid *g, const u8 x, const u8 y, const u8 side);
+io_slot *grid_step_edge(grid *g, const u8 x, const u8 y, const u8 side);
+
+void block_decode_program(block *b);
+decoded_instruction decode_instruction(const u8 *bytes, u8 pc);
+u8 instruction_operand_bytes(instruction i);
+
+const char *op_code_str(u8 opcode);
+const char *target_str(u8 target);
+
+// why run_grid returned
+typedef enum
+{
+    GRID_IDLE,       // no block had anything left to do
+    GRID_TICK_LIMIT, // ran up to max_ticks
+    GRID_DEADLOCK,   // every live block is blocked on a neighbour, see print_deadlock
+} grid_status;
+
+grid_status run_grid(grid *g, u32 max_ticks);
+// the last run_grid again from where the inputs changed since, false if it was not recorded or they changed too early
+bool rerun_grid(grid *g, grid_status *status);
+// run_grid with two-phase ticks, the rows split across threads, see parallel.h
+grid_status run_grid_parallel(grid *g, u32 max_ticks, int threads);
+// run_grid with every independent part of the grid on its own thread, see components.h
+grid_status run_grid_components(grid *g, u32 max_ticks, int threads);
+// every block runs as fast as its transfers let it on a pool of threads, with no ticks, see actors.h
+grid_status run_grid_actors(grid *g, u32 max_steps, int threads);
+void print_deadlock(FILE *f, grid *g);
+void print_pruned(FILE *f, const grid *g);
 void free_grid(grid *g);
 
+#ifdef BLOCKLANG_SEQUENCE_STATS
+void print_sequence_stats(FILE *f);
+#endif
+
 // Debug tokenizer
 
 void debug_tokenize(const char *src);
@@ -0,0 +1,77 @@
+#ifndef BLOCKLANG_HISTORY_H
+#define BLOCKLANG_HISTORY_H 1
+
+#include "definitions.h"
+
+/*
+    Checkpoints of a run, for rerunning it with changed inputs
+
+    With grid.checkpoints set, run_grid keeps the slots as they were when it started and a checkpoint of everything
+    that changes while it runs every so many ticks. The interval doubles (and every other checkpoint is dropped)
+    whenever they run out, so a run of any length keeps between HISTORY_CHECKPOINTS / 2 and HISTORY_CHECKPOINTS of
+    them.
+
+    An input byte can only matter from the tick it is read, and a slot's length from the tick a read or write finds
+    the slot at its end (io_slot.ended, kept with every checkpoint), so a checkpoint taken while the slot cursor was
+    still before the first changed byte, or at it with the end not found yet, is exactly what running again from the
+    start would pass through. The start of the run always is, and it is the only one left once an output slot gets or
+    loses its length with grid.prune set. rerun_grid goes back to the latest one that holds for every changed slot and
+    runs from there to the same max_ticks, which ends where a fresh run_grid with the new inputs would.
+
+    Programs that write to their own bytecode are not recorded, neither are runs on a compiled grid. load_program
+    drops the history.
+*/
+
+#define HISTORY_CHECKPOINTS 64
+#define HISTORY_INTERVAL 64 // ticks between checkpoints to begin with
+
+// what a tick can change in a block, traces are dropped on restore instead of being kept
+typedef struct
+{
+    u8 current_instruction;
+    u8 registers[4];
+    u8 accumulator;
+    u8 stack[16];
+    i8 stack_top;
+    u8 waiting_ticks;
+    u8 transfer_value;
+    bool io_blocked;
+    bool state_halted;
+    bool parked;
+    u8 watchers;
+    u8 last_caused_overflow;
+    u8 fused_ticks;
+    u8 fused_resume;
+} block_checkpoint;
+
+typedef struct
+{
+    u32 ticks;
+    u16 live_count;
+    u16 parked_count;
+    u8 soonest_wake;
+    live_block live[256];
+    u8 cur[256]; // slot cursors
+    bool ended[256]; // io_slot.ended
+    block_checkpoint blocks[256];
+} grid_checkpoint;
+
+struct grid_history
+{
+    bool recording; // false if the run could not be recorded
+    u32 max_ticks;
+    u32 interval;
+    u16 count;
+    io_slot slots[256]; // as they were when the run started, or last rerun
+    grid_checkpoint checkpoints[HISTORY_CHECKPOINTS];
+};
+
+void history_begin(grid *g, u32 max_ticks); // run_grid starts a new run
+void history_tick(grid *g);                  // before every tick, takes a checkpoint once one is due
+
+// goes back to the last checkpoint the slot changes since the run leave valid, false if the run was not recorded or a
+// slot changed from input to output or back
+bool history_restore(grid *g);
+void history_release(grid *g);
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef BLOCKLANG_JIT_H
+#define BLOCKLANG_JIT_H 1
+
+#include "definitions.h"
+
+/*
+    Template JIT for block programs
+
+    Every local instruction the templates know (arithmetic, GET, PUT to registers, jumps, WAIT and the bitwise
+    extended ops, with ACC, RGx, ADJ, NIL or CUR as target) is translated to a small native function that does
+    exactly what one tick of the interpreter would do, including moving the pc. Anything touching a side, the stack,
+    REF or ADJ writes is left to the interpreter, which is also what runs when the host is not x86-64.
+
+    Code lives in its own executable pages per block. Bytecode writes through REF/ADJ drop the native entries that
+    cover the written byte, those instructions go back to being interpreted.
+*/
+
+typedef void (*jit_step_fn)(block *b);
+
+struct block_jit
+{
+    u8 *code;
+    u32 size;
+    u16 entry[256]; // offset + 1 of the native code for an instruction at that address, 0 if there is none
+};
+
+bool jit_supported(void);
+
+// translates b's program, false if the host has no JIT support or the pages could not be mapped
+bool jit_compile_block(block *b);
+void jit_release_block(block *b);
+
+static inline void jit_invalidate(block *b, u8 pc)
+{
+    b->jit->entry[pc] = 0;
+}
+
+// runs the instruction at the current pc natively, false if there is no native version of it
+static inline bool jit_step(block *b)
+{
+    const u16 entry = b->jit->entry[b->current_instruction];
+    if (!entry)
+        return false;
+
+    union
+    {
+        u8 *code;
+        jit_step_fn fn;
+    } step = {.code = b->jit->code + entry - 1};
+
+    step.fn(b);
+    return true;
+}
+
+#endif
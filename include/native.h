@@ -0,0 +1,85 @@
+#ifndef BLOCKLANG_NATIVE_H
+#define BLOCKLANG_NATIVE_H 1
+
+#include <stdio.h>
+
+#include "definitions.h"
+
+/*
+    Ahead-of-time translation of block programs to C
+
+    bl2c turns a program into one C function that performs a single tick of it: a switch over the pc with a case
+    per address and every operand resolved. The function is built into a shared object and loaded in place of the
+    interpreter for a block, everything around the instruction (halts, WAIT, the tick loop) stays in the VM.
+
+    A whole grid can be compiled the same way into one function that ticks every block in order. There the neighbours
+    and edge slots each transfer goes through are resolved too, so the result is only valid for the programs and grid
+    size it was generated for; load_program drops it.
+
+    Generated code includes this header and reaches back into the VM only through native_api, so the shared object
+    needs no symbols from the executable that loads it.
+
+    Only programs that never write to their own bytecode are translated, in a compiled grid blocks running anything
+    else are handed to the interpreter.
+*/
+
+typedef struct
+{
+    bool (*read_from_io)(grid *g, block *b, u8 x, u8 y, side s, u8 *out_value);
+    void (*write_to_side)(grid *g, block *b, u8 x, u8 y, side s, u8 value);
+    u8 (*pop_stack)(block *b);
+    void (*interpret)(grid *g, block *b, u8 x, u8 y); // runs the instruction at the pc through the interpreter
+
+    // transfers with the neighbour and edge slot already looked up, for compiled grids
+    bool (*read_from_block)(block *b, block *src, side s, u8 *out_value);
+    bool (*read_from_slot)(block *b, io_slot *slot, u8 *out_value);
+    void (*write_to_neighbour)(block *b, block *dst, io_slot *slot, side s, u8 value);
+    bool (*write_to_slot)(io_slot *slot, u8 value);
+    void (*exec_block)(grid *g, block *b, u8 x, u8 y); // a whole interpreted tick of the block
+} native_api;
+
+typedef void (*native_tick_fn)(grid *g, block *b, u8 x, u8 y, const native_api *api);
+typedef void (*native_grid_tick_fn)(grid *g, const native_api *api);
+
+#define NATIVE_TICK_SYMBOL "blocklang_tick"
+#define NATIVE_GRID_TICK_SYMBOL "blocklang_grid_tick"
+
+struct block_native
+{
+    native_tick_fn tick;
+    void *library;
+};
+
+struct grid_native
+{
+    native_grid_tick_fn tick;
+    void *library;
+};
+
+extern const native_api native_vm_api;
+
+// writes the C translation of a program as function_name, false if the program modifies itself
+bool native_emit_c(FILE *out, const u8 *bytecode, u8 length, const char *function_name);
+
+// writes one tick of the whole grid as function_name
+bool native_emit_grid_c(FILE *out, grid *g, const char *function_name);
+
+const char *native_library_extension(void); // .so or .dll
+const char *native_include_dir(void);       // $BLOCKLANG_INCLUDE, include/ relative to the working directory if unset
+
+// compiles a translation into a shared object with $CC (cc if unset), include_dir is where this header lives
+bool native_compile(const char *c_path, const char *lib_path, const char *include_dir);
+
+// loads function_name from lib_path and makes the block at x, y run it instead of the interpreter
+bool native_load(grid *g, u8 x, u8 y, const char *lib_path, const char *function_name);
+void native_release_block(block *b);
+
+// all of the above for the program loaded at x, y, files are named after path_prefix
+bool native_build_and_load(grid *g, u8 x, u8 y, const char *path_prefix, const char *include_dir);
+
+// same for the whole grid, run_grid then calls the compiled tick instead of interpreting any block
+bool native_load_grid(grid *g, const char *lib_path, const char *function_name);
+bool native_build_and_load_grid(grid *g, const char *path_prefix, const char *include_dir);
+void native_release_grid(grid *g);
+
+#endif
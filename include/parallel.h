@@ -0,0 +1,53 @@
+#ifndef BLOCKLANG_PARALLEL_H
+#define BLOCKLANG_PARALLEL_H 1
+
+#include <pthread.h>
+
+#include "definitions.h"
+
+/*
+    run_grid on several threads
+
+    run_grid_parallel runs two-phase ticks (grid.two_phase, which it turns on) with the rows of the grid split into one
+    band per thread. every tick each thread posts the intents of the live blocks in its band, waits for the others,
+    commits them and waits again, then the calling thread does the rest of the tick alone: REF/ADJ writes, dropping
+    halted blocks, and everything run_grid does between ticks. a block only looks at the intents of its neighbours, so
+    the only thing crossing bands is the row of intents on either side of a boundary, read after the barrier that
+    ends the posting.
+
+    every block goes through exactly what grid_tick_two_phase does with it, so the results are the same bit for bit
+    as run_grid with grid.two_phase set, for any number of threads.
+*/
+
+#define PARALLEL_MAX_THREADS 64
+
+struct grid_pool;
+
+typedef struct
+{
+    struct grid_pool *pool;
+    u16 band;
+} pool_worker;
+
+struct grid_pool
+{
+    grid *g;
+    u16 bands;
+    bool stop;
+    pthread_mutex_t starting; // held while the threads are started, the bands are only known once they all are
+    pthread_barrier_t barrier;
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    pool_worker workers[PARALLEL_MAX_THREADS];
+    u8 first_row[PARALLEL_MAX_THREADS + 1]; // band n covers rows first_row[n] up to first_row[n + 1]
+    u16 from[PARALLEL_MAX_THREADS + 1];     // its part of the live list this tick
+    bool changed[PARALLEL_MAX_THREADS];
+};
+
+// the halves of a two-phase tick over live[from] up to live[to], and what is left of it once both ran everywhere
+void grid_post_intents(grid *g, u16 from, u16 to);
+bool grid_commit_intents(grid *g, u16 from, u16 to); // false if all the blocks did was stay blocked
+void grid_finish_two_phase(grid *g, bool changed);
+
+void parallel_tick(grid *g); // run_grid calls it for every tick while grid.pool is set
+
+#endif
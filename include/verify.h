@@ -0,0 +1,24 @@
+#ifndef BLOCKLANG_VERIFY_H
+#define BLOCKLANG_VERIFY_H 1
+
+#include "definitions.h"
+
+/*
+    Load-time bytecode verifier
+
+    A program is verified when, starting at address 0 with an empty stack, everything it can reach satisfies:
+    - each address is the start of an instruction in the linear decoding of the program and its operands are inside
+      the program, so the pc never wraps, is never clamped and never lands in data
+    - each jump goes to a constant address (ADJ, NIL or CUR)
+    - nothing writes through REF or ADJ, so the instructions decoded at load stay valid
+    - the stack depth at each address is the same on every path, POP and STK always find a value and PUSH always
+      finds room, and no PUSH or POP goes through a side (a blocked transfer repeats the stack operation)
+    - each EXT sub-opcode exists
+
+    load_program marks verified blocks, they run on a variant of the interpreter with the wrap, clamp, stack and EXT
+    checks compiled out. REF reads stay checked since their address is whatever ACC holds.
+*/
+
+bool verify_program(const u8 *bytecode, u8 length);
+
+#endif
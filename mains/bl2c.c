@@ -0,0 +1,83 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../include/definitions.h"
+#include "../include/native.h"
+#include "../include/objfile.h"
+
+/*
+    Translates a compiled block program to C, see native.h
+
+    -f <filename> for an input object file
+    -o <filename> for the C output
+    -n <name> for the generated function, blocklang_tick by default
+
+    Build the output with `cc -O2 -shared -fPIC -Iinclude`, block -n does all of this by itself
+*/
+
+int main(int argc, char *argv[])
+{
+    int c;
+    const char *input_file = NULL;
+    const char *output_file = NULL;
+    const char *function_name = NATIVE_TICK_SYMBOL;
+
+    while ((c = getopt(argc, argv, ":o:f:n:")) != -1)
+        switch (c)
+        {
+        case 'f':
+            input_file = optarg;
+            break;
+        case 'o':
+            output_file = optarg;
+            break;
+        case 'n':
+            function_name = optarg;
+            break;
+        case ':':
+            fprintf(stderr, "Option needs a value\n");
+            break;
+        case '?':
+            if (isprint(optopt))
+                fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+            else
+                fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+            return 1;
+        default:
+        usage:
+            fprintf(stderr, "Usage: -f <object file> -o <output file> [-n <function name>]\n");
+            return 1;
+        }
+
+    if (input_file == NULL || output_file == NULL)
+        goto usage;
+
+    block_object_file obj = {0};
+    if (!objfile_read_file(input_file, &obj))
+    {
+        fprintf(stderr, "Failed to read object file: %s\n", input_file);
+        return 1;
+    }
+
+    FILE *out = fopen(output_file, "w");
+    if (!out)
+    {
+        fprintf(stderr, "Failed to open output file: %s\n", output_file);
+        return 1;
+    }
+
+    const bool emitted = native_emit_c(out, obj.bytecode, obj.bytecode_length, function_name);
+    fclose(out);
+
+    if (!emitted)
+    {
+        fprintf(stderr, "Cannot translate %s: the program is empty or writes to its own bytecode\n", input_file);
+        remove(output_file);
+        return 1;
+    }
+
+    return 0;
+}
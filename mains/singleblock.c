@@ -6,6 +6,7 @@
 #include <unistd.h>
 
 #include "../include/definitions.h"
+#include "../include/native.h"
 #include "../include/objfile.h"
 
 /*
@@ -149,6 +150,12 @@ void print_compact_state(grid *g, const block_object_file *obj, const u8 *out_bu
            g->blocks[0].stack_top + 1, out_buffer);
 }
 
+void load_native(grid *g, const char *input_file)
+{
+    if (!native_build_and_load(g, 0, 0, input_file, native_include_dir()))
+        fprintf(stderr, "Could not build %s as native code, interpreting it\n", input_file);
+}
+
 int main(int argc, char *argv[])
 {
     int c;
@@ -156,10 +163,30 @@ int main(int argc, char *argv[])
 
     bool run_immediately = false;
     bool debug_mode = false;
+    bool sequence_stats = false;
+    bool jit = false;
+    bool native = false;
+    bool fuse = false;
+    bool trace = false;
 
-    while ((c = getopt(argc, argv, "drf:")) != -1)
+    while ((c = getopt(argc, argv, "drsjnutf:")) != -1)
         switch (c)
         {
+        case 'j':
+            jit = true;
+            break;
+        case 'n':
+            native = true;
+            break;
+        case 'u':
+            fuse = true;
+            break;
+        case 't':
+            trace = true;
+            break;
+        case 's':
+            sequence_stats = true;
+            break;
         case 'd':
             debug_mode = true;
             break;
@@ -180,10 +207,15 @@ int main(int argc, char *argv[])
             return 1;
         default:
         usage:
-            fprintf(stderr, "Usage: -f <bytecode file> [-d] [-r]\n");
+            fprintf(stderr, "Usage: -f <bytecode file> [-d] [-r] [-s] [-j] [-n] [-u] [-t]\n");
             fprintf(stderr, "  -f: bytecode file (required)\n");
             fprintf(stderr, "  -d: debug mode (interactive stepping)\n");
             fprintf(stderr, "  -r: run immediately (no stdin for first execution)\n");
+            fprintf(stderr, "  -s: print executed instruction pair/triple counts to stderr on exit\n");
+            fprintf(stderr, "  -j: translate the program to native code (x86-64 only, ignored elsewhere)\n");
+            fprintf(stderr, "  -n: translate the program to C next to the bytecode file, build it with $CC and run that\n");
+            fprintf(stderr, "  -u: run common instruction sequences as superinstructions instead of in batches\n");
+            fprintf(stderr, "  -t: record hot loops and run them along the recorded trace instead of in batches\n");
             return 1;
         }
 
@@ -206,7 +238,22 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+#ifndef BLOCKLANG_SEQUENCE_STATS
+    if (sequence_stats)
+        fprintf(stderr, "Built without BLOCKLANG_SEQUENCE_STATS, -s does nothing\n");
+#else
+    // the counts only see interpreted instructions
+    if (jit || native)
+        fprintf(stderr, "Built with BLOCKLANG_SEQUENCE_STATS, -j and -n do nothing\n");
+    native = false;
+#endif
+
     grid *g = initialize_grid(1, 1);
+    g->fuse = fuse;
+    g->trace = trace;
+    g->batch = !fuse && !trace; // batches take over from both
+    g->cycles = true;
+    g->jit = jit;
 
     u8 *in_buffer;
     u8 *out_buffer;
@@ -218,6 +265,8 @@ int main(int argc, char *argv[])
     slot_set_length(g, down, 0, 0xff);
 
     load_program(g, 0, 0, obj.bytecode, bytecode_len);
+    if (native)
+        load_native(g, input_file);
 
     bool in_debug_mode = debug_mode && obj.has_debug_info;
 
@@ -279,6 +328,11 @@ int main(int argc, char *argv[])
                 memset(out_buffer, 0, 256);
                 free_grid(g);
                 g = initialize_grid(1, 1);
+                g->fuse = fuse;
+                g->trace = trace;
+                g->batch = !fuse && !trace;
+                g->cycles = true;
+                g->jit = jit;
                 in_buffer = attach_input(g, up, 0);
                 out_buffer = attach_output(g, down, 0);
 
@@ -286,6 +340,8 @@ int main(int argc, char *argv[])
                 slot_set_length(g, down, 0, 0xff);
 
                 load_program(g, 0, 0, obj.bytecode, bytecode_len);
+                if (native)
+                    load_native(g, input_file);
                 display_debug_ui(g, &obj, out_buffer);
                 break;
             }
@@ -373,6 +429,10 @@ int main(int argc, char *argv[])
             {
                 printf("Grid ticked for %d ticks, aborting\n", g->ticks);
                 printf("Current output: %.255s\n", out_buffer);
+#ifdef BLOCKLANG_SEQUENCE_STATS
+                if (sequence_stats)
+                    print_sequence_stats(stderr);
+#endif
                 abort();
             }
 
@@ -387,6 +447,11 @@ int main(int argc, char *argv[])
         }
     }
 
+#ifdef BLOCKLANG_SEQUENCE_STATS
+    if (sequence_stats)
+        print_sequence_stats(stderr);
+#endif
+
     free_grid(g);
 
     return 0;
@@ -4,8 +4,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../include/batch.h"
 #include "../include/config.h"
 #include "../include/definitions.h"
+#include "../include/native.h"
 #include "../include/objfile.h"
 #include "../include/utils.h"
 
@@ -49,17 +51,12 @@ static void attach_io_from_spec(grid *g, const io_spec *spec)
         exit(1);
     }
 
+    // batches fill slots from several threads at once, so no strtok
     if (spec->values[0] != '=')
     {
-        char values_copy[256];
-        strncpy(values_copy, spec->values, sizeof(values_copy) - 1);
-
-        char *token = strtok(values_copy, ",");
-        while (token)
-        {
-            data[data_size++] = (u8)atoi(token);
-            token = strtok(NULL, ",");
-        }
+        for (const char *c = spec->values; *c; c++)
+            if (*c != ',' && (c == spec->values || c[-1] == ','))
+                data[data_size++] = (u8)atoi(c);
     }
     else
         data_size = 255;
@@ -67,17 +64,8 @@ static void attach_io_from_spec(grid *g, const io_spec *spec)
     slot_set_length(g, side_num, spec->slot, data_size);
 }
 
-static bool run_with_config(vm_config *config)
+static bool assemble_programs(vm_config *config)
 {
-    grid *g = initialize_grid(config->layout_width, config->layout_height);
-    if (!g)
-    {
-        fprintf(stderr, "Failed to initialize grid\n");
-        return false;
-    }
-
-    g->debug = config->debug;
-
     for (u8 i = 0; i < config->program_count; i++)
     {
         char filepath[256];
@@ -87,7 +75,6 @@ static bool run_with_config(vm_config *config)
         if (!source)
         {
             fprintf(stderr, "Failed to read source file: %s\n", filepath);
-            free_grid(g);
             return false;
         }
 
@@ -99,7 +86,6 @@ static bool run_with_config(vm_config *config)
         {
             fprintf(stderr, "Assembly failed for %s\n", filepath);
             free(source);
-            free_grid(g);
             return false;
         }
 
@@ -108,6 +94,28 @@ static bool run_with_config(vm_config *config)
         config->programs[i].bytecode_len = bytecode_len;
     }
 
+    return true;
+}
+
+// blocks of program i run bytecode[i], self-modifying programs write to it
+static grid *build_grid(const vm_config *config, void *const *bytecode)
+{
+    grid *g = initialize_grid(config->layout_width, config->layout_height);
+    if (!g)
+    {
+        fprintf(stderr, "Failed to initialize grid\n");
+        return NULL;
+    }
+
+    g->debug = config->debug;
+    g->fuse = config->fuse;
+    g->trace = config->trace;
+    g->batch = config->batch;
+    g->cycles = config->cycles;
+    g->prune = config->prune;
+    g->jit = config->jit;
+    g->two_phase = config->two_phase;
+
     for (u8 y = 0; y < config->layout_height; y++)
     {
         for (u8 x = 0; x < config->layout_width; x++)
@@ -118,7 +126,7 @@ static bool run_with_config(vm_config *config)
             {
                 if (config->programs[i].key == block_char)
                 {
-                    load_program(g, x, y, config->programs[i].bytecode, config->programs[i].bytecode_len);
+                    load_program(g, x, y, bytecode[i], config->programs[i].bytecode_len);
                     break;
                 }
             }
@@ -127,7 +135,7 @@ static bool run_with_config(vm_config *config)
 
     for (u8 i = 0; i < config->io_spec_count; i++)
     {
-        io_spec *spec = &config->io_specs[i];
+        const io_spec *spec = &config->io_specs[i];
         if (spec->block_key == 0)
         {
             attach_io_from_spec(g, spec);
@@ -141,7 +149,7 @@ static bool run_with_config(vm_config *config)
             char block_char = config->layout[y][x];
             for (u8 i = 0; i < config->io_spec_count; i++)
             {
-                io_spec *spec = &config->io_specs[i];
+                const io_spec *spec = &config->io_specs[i];
                 if (spec->block_key != 0 && spec->block_key == block_char)
                 {
                     attach_io_from_spec(g, spec);
@@ -150,21 +158,14 @@ static bool run_with_config(vm_config *config)
         }
     }
 
-    run_grid(g, config->ticks_limit);
-
-    if(g->ticks >= config->ticks_limit)
-    {
-        printf("Ran out of ticks\n");
-    }
-
-    for (u8 i = 0; i < config->program_count; i++)
-    {
-        free(config->programs[i].bytecode);
-    }
+    return g;
+}
 
+static void print_outputs(const vm_config *config, grid *g)
+{
     for (u8 i = 0; i < config->io_spec_count; i++)
     {
-        io_spec *spec = &config->io_specs[i];
+        const io_spec *spec = &config->io_specs[i];
         if (spec->direction[0] != 'o')
             continue;
         
@@ -192,17 +193,248 @@ static bool run_with_config(vm_config *config)
         }
         printf("\n");
     }
+}
+
+// the bytes an output slot got, as print_outputs shows them
+static bool same_outputs(const vm_config *config, grid *a, grid *b)
+{
+    for (u8 i = 0; i < config->io_spec_count; i++)
+    {
+        const io_spec *spec = &config->io_specs[i];
+        if (spec->direction[0] != 'o')
+            continue;
+
+        const u8 offset = io_slot_offset(a, string_to_side(spec->side), spec->slot);
+        const io_slot *x = &a->slots[offset], *y = &b->slots[offset];
+        if (x->len != y->len || memcmp(x->bytes, y->bytes, x->len) != 0)
+            return false;
+    }
+    return true;
+}
+
+static bool run_with_config(vm_config *config, const char *config_path)
+{
+    if (!assemble_programs(config))
+        return false;
+
+    void *bytecode[MAX_DEFINITIONS];
+    for (u8 i = 0; i < config->program_count; i++)
+        bytecode[i] = config->programs[i].bytecode;
 
+    grid *g = build_grid(config, bytecode);
+    if (!g)
+        return false;
+
+    if (config->actors)
+    {
+        // only the data is meant to come out the same, so the lockstep run is the reference and is not printed. it
+        // gets its own copy of the programs for the self-modifying ones
+        void *copies[MAX_DEFINITIONS];
+        for (u8 i = 0; i < config->program_count; i++)
+        {
+            copies[i] = malloc(MAX_BYTECODE_SIZE);
+            memcpy(copies[i], bytecode[i], config->programs[i].bytecode_len);
+        }
+
+        grid *lockstep = build_grid(config, copies);
+        const grid_status reference = lockstep ? run_grid(lockstep, config->ticks_limit) : GRID_TICK_LIMIT;
+
+        const grid_status status = run_grid_actors(g, config->ticks_limit, config->threads);
+        if (status == GRID_DEADLOCK)
+            printf("Actors deadlocked\n");
+
+        // where a run that was cut short got to depends on the timing
+        bool same = true;
+        if (status == GRID_TICK_LIMIT || reference == GRID_TICK_LIMIT)
+            printf("Ran out of ticks, outputs not compared\n");
+        else
+        {
+            same = same_outputs(config, g, lockstep);
+            printf(same ? "Actor outputs match lockstep\n" : "Actor outputs differ from lockstep\n");
+        }
+
+        print_outputs(config, g);
+        if (lockstep)
+            free_grid(lockstep);
+        free_grid(g);
+        for (u8 i = 0; i < config->program_count; i++)
+            free(copies[i]);
+        return same;
+    }
+
+    if (config->compiled)
+    {
+        // slot contents are still read at run time, only the layout and the programs are baked in
+        char prefix[256];
+        snprintf(prefix, sizeof(prefix), "%s.grid", config_path);
+        if (!native_build_and_load_grid(g, prefix, native_include_dir()))
+            fprintf(stderr, "Could not compile the grid, interpreting it\n");
+    }
+
+    // independent parts of the layout on their own threads, the outcome is the same as run_grid
+    const grid_status status = config->threads > 1 ? run_grid_components(g, config->ticks_limit, config->threads)
+                                                   : run_grid(g, config->ticks_limit);
+
+    if (config->debug)
+        print_pruned(stdout, g);
+
+    if (status == GRID_TICK_LIMIT)
+    {
+        printf("Ran out of ticks\n");
+    }
+    else if (status == GRID_DEADLOCK)
+    {
+        printf("Deadlocked after %u ticks\n", g->ticks);
+        print_deadlock(stdout, g);
+    }
+
+    print_outputs(config, g);
     free_grid(g);
     return true;
 }
 
+typedef struct
+{
+    const vm_config *config;
+    char **records;
+    char **results; // one line per record, in the order of the records
+} batch_job;
+
+// the ;-separated fields of a record replace the values of the input slots of the config in order, inputs past the
+// last field keep them
+static void batch_fill(grid *g, u32 record, void *context)
+{
+    const batch_job *job = context;
+    const char *field = job->records[record];
+
+    for (u8 i = 0; i < job->config->io_spec_count && field; i++)
+    {
+        io_spec spec = job->config->io_specs[i];
+        if (spec.direction[0] != 'i')
+            continue;
+
+        const char *end = strchr(field, ';');
+        size_t len = end ? (size_t)(end - field) : strlen(field);
+        if (len > sizeof(spec.values) - 1)
+            len = sizeof(spec.values) - 1;
+
+        memcpy(spec.values, field, len);
+        spec.values[len] = '\0';
+        attach_io_from_spec(g, &spec);
+        field = end ? end + 1 : NULL;
+    }
+}
+
+// every output slot the way print_outputs shows it, on one line
+static void batch_collect(const grid *g, u32 record, grid_status status, void *context)
+{
+    batch_job *job = context;
+    const vm_config *config = job->config;
+
+    size_t size = 32;
+    for (u8 i = 0; i < config->io_spec_count; i++)
+        size += sizeof(config->io_specs[i].side) + 16 + 5 * 256;
+
+    char *line = malloc(size);
+    if (!line)
+        return;
+
+    int used = 0;
+    for (u8 i = 0; i < config->io_spec_count; i++)
+    {
+        const io_spec *spec = &config->io_specs[i];
+        if (spec->direction[0] != 'o')
+            continue;
+
+        const io_slot *slot = &g->slots[io_slot_offset(g, string_to_side(spec->side), spec->slot)];
+        used += sprintf(line + used, "%s%s %d: ", used ? "; " : "", spec->side, spec->slot);
+
+        for (u8 j = 0; j < slot->len; j++)
+            if (slot->bytes[j] != 0)
+                used += sprintf(line + used, config->print_strings ? "%c" : "0x%02X ", slot->bytes[j]);
+    }
+
+    if (status == GRID_TICK_LIMIT)
+        sprintf(line + used, " (ran out of ticks)");
+    else if (status == GRID_DEADLOCK)
+        sprintf(line + used, " (deadlocked after %u ticks)", g->ticks);
+
+    job->results[record] = line;
+}
+
+// the layout is assembled and set up once, every line of the records file runs on a copy of it
+static bool run_batch_with_config(vm_config *config, const char *records_path)
+{
+    char *text = read_to_heap(records_path);
+    if (!text)
+    {
+        fprintf(stderr, "Failed to read records file: %s\n", records_path);
+        return false;
+    }
+
+    u32 lines = 1;
+    for (const char *c = text; *c; c++)
+        lines += *c == '\n';
+
+    char **records = malloc(lines * sizeof(char *));
+    char **results = calloc(lines, sizeof(char *));
+    u32 count = 0;
+
+    for (char *line = text; line && records && results;)
+    {
+        char *next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+
+        size_t len = strlen(line);
+        if (len && line[len - 1] == '\r')
+            line[--len] = '\0';
+        if (len || next) // an empty line runs with the inputs of the config, only the end of the file is no record
+            records[count++] = line;
+
+        line = next;
+    }
+
+    bool ok = records && results && assemble_programs(config);
+    grid *template = NULL;
+
+    if (ok)
+    {
+        void *bytecode[MAX_DEFINITIONS];
+        for (u8 i = 0; i < config->program_count; i++)
+            bytecode[i] = config->programs[i].bytecode;
+
+        template = build_grid(config, bytecode);
+        ok = template != NULL;
+    }
+
+    if (ok)
+    {
+        batch_job job = {.config = config, .records = records, .results = results};
+        run_grid_batch(template, count, config->ticks_limit, config->threads, batch_fill, batch_collect, &job);
+
+        for (u32 i = 0; i < count; i++)
+            printf("%u: %s\n", i, results[i] ? results[i] : "(out of memory)");
+        free_grid(template);
+    }
+
+    for (u32 i = 0; i < count && results; i++)
+        free(results[i]);
+    free(results);
+    free(records);
+    free(text);
+    return ok;
+}
+
 int main(int argc, char *argv[])
 {
     if (argc < 2)
     {
         printf("Usage:\n");
         printf("  Config mode: %s <config.cfg>\n", argv[0]);
+        printf("  Batch mode: %s <config.cfg> <records>\n", argv[0]);
+        printf("    one run per line of records, ;-separated values for the input slots of the config in order,\n");
+        printf("    on threads:N threads. prints the output slots of every run in the order of the lines\n");
         printf("\nConfig file format:\n");
         printf("  # Comment\n");
         printf("  program_dir: programs/\n");
@@ -217,6 +449,16 @@ int main(int argc, char *argv[])
         printf("  debug:true\n");
         printf("  ticks:128\n");
         printf("  print_strings:true\n");
+        printf("  jit:false\n");
+        printf("  fuse:false\n");
+        printf("  trace:false\n");
+        printf("  batch:false\n");
+        printf("  cycles:false\n");
+        printf("  prune:false\n");
+        printf("  compiled:false\n");
+        printf("  two_phase:false\n");
+        printf("  threads:1\n");
+        printf("  actors:false\n");
         return 1;
     }
 
@@ -229,8 +471,19 @@ int main(int argc, char *argv[])
             return 1;
         }
 
-        bool result = run_with_config(&config);
+        bool result = run_with_config(&config, argv[1]);
         free_config(&config);
         return result ? 0 : 1;
     }
+
+    vm_config config;
+    if (!parse_config(argv[1], &config))
+    {
+        fprintf(stderr, "Failed to parse config file\n");
+        return 1;
+    }
+
+    bool result = run_batch_with_config(&config, argv[2]);
+    free_config(&config);
+    return result ? 0 : 1;
 }
@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# hottest fall-through instruction pairs and triples over every program in programs/asm/, run from build/
+# needs the tools built with `make SEQUENCE_STATS=1`
+
+rm -f stats.txt
+for f in programs/asm/*; do
+    ./basm.exe -o o.b -f $f && echo "12345" | ./block -s -f o.b >/dev/null 2>>stats.txt
+done
+
+for kind in pair triple; do
+    echo "== ${kind}s"
+    grep "^$kind " stats.txt | awk '{ n = $NF; $NF = ""; sum[$0] += n } END { for (k in sum) print sum[k], k }' | sort -rn | head -20
+done
+
+grep "^dropped triples " stats.txt | awk '{ n += $NF } END { if (n) print n, "triple runs not counted, the table was full" }'
@@ -0,0 +1,392 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/actors.h"
+#include "../include/history.h"
+
+enum
+{
+    ACTOR_QUEUED,  // in a deque or running
+    ACTOR_BLOCKED, // left an offer, waits for a neighbour to take it
+    ACTOR_HALTED,  // or has no program
+    ACTOR_STOPPED, // ran out of steps
+};
+
+typedef struct
+{
+    u8 state;
+    u8 kind; // INTENT_READ or INTENT_WRITE while blocked
+    u8 side;
+    u8 value;  // offered by a blocked write, or handed to a blocked read
+    bool done; // a neighbour completed the transfer it was blocked on
+    u32 steps;
+} block_actor;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    u16 top, bottom; // thieves take from the top, the owner pushes and pops at the bottom
+    u8 blocks[256];
+} actor_deque;
+
+typedef struct
+{
+    grid *g;
+    u32 max_steps;
+    u16 workers;
+    pthread_mutex_t handoff; // held while looking at or changing another block's actor
+    atomic_int pending;      // actors queued or running, the run is over once there are none
+    block_actor actors[256];
+    actor_deque deques[ACTORS_MAX_THREADS];
+} actor_run;
+
+typedef struct
+{
+    actor_run *run;
+    u16 worker;
+} actor_worker;
+
+static void deque_push(actor_deque *q, u8 n)
+{
+    pthread_mutex_lock(&q->lock);
+    q->blocks[q->bottom++ % 256] = n;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static bool deque_pop(actor_deque *q, u8 *n)
+{
+    pthread_mutex_lock(&q->lock);
+    const bool any = q->bottom != q->top;
+    if (any)
+        *n = q->blocks[--q->bottom % 256];
+    pthread_mutex_unlock(&q->lock);
+    return any;
+}
+
+static bool deque_steal(actor_deque *q, u8 *n)
+{
+    pthread_mutex_lock(&q->lock);
+    const bool any = q->bottom != q->top;
+    if (any)
+        *n = q->blocks[q->top++ % 256];
+    pthread_mutex_unlock(&q->lock);
+    return any;
+}
+
+// handoff held
+static void actor_wake(actor_run *r, u16 worker, u16 n, bool done)
+{
+    r->actors[n].state = ACTOR_QUEUED;
+    r->actors[n].done = done;
+    atomic_fetch_add(&r->pending, 1);
+    deque_push(&r->deques[worker], n);
+}
+
+// neighbour on side s of the block at n is blocked on a transfer of that kind with it
+static block_actor *actor_peer_waiting(actor_run *r, u16 n, side s, u8 kind)
+{
+    const block *peer = r->g->links[n].neighbour[s];
+    if (!peer)
+        return NULL;
+
+    block_actor *a = &r->actors[peer - r->g->blocks];
+    const bool toward = a->side == get_opposite_side(s) || (kind == INTENT_READ && a->side == any);
+    return a->state == ACTOR_BLOCKED && a->kind == kind && toward ? a : NULL;
+}
+
+static bool actor_peer_live(actor_run *r, u16 n, side s)
+{
+    const block *peer = r->g->links[n].neighbour[s];
+    return peer && r->actors[peer - r->g->blocks].state != ACTOR_HALTED;
+}
+
+// handoff held. completes the transfer d of the block at n, leaves an offer or finds it cannot be done
+static u8 actor_transfer(actor_run *r, u16 worker, u16 n, const decoded_instruction *d, u8 *value)
+{
+    grid *g = r->g;
+    block *b = &g->blocks[n];
+    block_actor *a = &r->actors[n];
+    const block_links *l = &g->links[n];
+    const bool writing = d->flags & DECODED_WRITING;
+    const side s = d->side;
+
+    u8 offer = 0;
+    if (writing)
+        offer = d->operation == PUT ? b->accumulator : b->stack_top >= 0 ? b->stack[(u8)b->stack_top] : 0;
+
+    block_actor *peer = NULL;
+    bool live = false;
+
+    if (s == any && writing)
+    {
+        for (side e = up; e <= left; e++)
+            if (block_write_to_slot(l->slot[e], offer))
+                return TRANSFER_DONE;
+        return TRANSFER_FAILED;
+    }
+
+    if (s == any)
+    {
+        for (side e = up; e <= left && !peer; e++)
+            peer = actor_peer_waiting(r, n, e, INTENT_WRITE);
+
+        for (side e = up; e <= left && !peer; e++)
+            if (l->slot[e] && can_read(l->slot[e]))
+            {
+                *value = read_byte(l->slot[e]);
+                return TRANSFER_DONE;
+            }
+
+        for (side e = up; e <= left; e++)
+            live |= actor_peer_live(r, n, e);
+    }
+    else if (l->neighbour[s])
+    {
+        peer = actor_peer_waiting(r, n, s, writing ? INTENT_READ : INTENT_WRITE);
+        live = actor_peer_live(r, n, s);
+    }
+    else if (writing)
+        return block_write_to_slot(l->slot[s], offer) ? TRANSFER_DONE : TRANSFER_FAILED;
+    else if (l->slot[s] && can_read(l->slot[s]))
+    {
+        *value = read_byte(l->slot[s]);
+        return TRANSFER_DONE;
+    }
+
+    if (peer)
+    {
+        if (writing)
+            peer->value = offer;
+        else
+            *value = peer->value;
+        actor_wake(r, worker, peer - r->actors, true);
+        return TRANSFER_DONE;
+    }
+
+    if (!live)
+        return TRANSFER_FAILED;
+
+    // a neighbour may pick the block up again as soon as handoff is released, nothing of it changes after this
+    b->io_blocked = true;
+    a->state = ACTOR_BLOCKED;
+    a->kind = writing ? INTENT_WRITE : INTENT_READ;
+    a->side = s;
+    a->value = offer;
+    return TRANSFER_BLOCKED;
+}
+
+// handoff held. neighbours blocked on the block at n try again, and find it halted
+static void actor_halt(actor_run *r, u16 worker, u16 n)
+{
+    r->actors[n].state = ACTOR_HALTED;
+
+    for (side s = up; s <= left; s++)
+    {
+        const block *peer = r->g->links[n].neighbour[s];
+        if (!peer)
+            continue;
+
+        const block_actor *a = &r->actors[peer - r->g->blocks];
+        if (a->state == ACTOR_BLOCKED && (a->side == get_opposite_side(s) || a->side == any))
+            actor_wake(r, worker, peer - r->g->blocks, false);
+    }
+}
+
+// runs the block at n until it blocks, halts, runs out of steps or has had its slice
+static void actor_run_block(actor_run *r, u16 worker, u16 n)
+{
+    grid *g = r->g;
+    block *b = &g->blocks[n];
+    block_actor *a = &r->actors[n];
+    const u8 x = n % g->width, y = n / g->width;
+
+    if (a->done) // the neighbour completed it while the block was blocked
+    {
+        block_finish_transfer(b, block_fetch_current(b), TRANSFER_DONE, a->value);
+        b->waiting_ticks = 0;
+        a->done = false;
+        a->steps++;
+    }
+
+    for (u32 slice = 0; slice < ACTORS_SLICE; slice++)
+    {
+        if (a->steps > r->max_steps)
+        {
+            pthread_mutex_lock(&r->handoff);
+            a->state = ACTOR_STOPPED;
+            pthread_mutex_unlock(&r->handoff);
+            return;
+        }
+
+        const decoded_instruction *d = block_fetch_current(b);
+
+        if (d->operation == HALT)
+        {
+            b->state_halted = true;
+            pthread_mutex_lock(&r->handoff);
+            actor_halt(r, worker, n);
+            pthread_mutex_unlock(&r->handoff);
+            return;
+        }
+
+        if (!(d->flags & DECODED_IO))
+        {
+            block_exec_local(g, b, x, y, d);
+            b->waiting_ticks = 0;
+            a->steps++;
+            continue;
+        }
+
+        u8 value = 0;
+        pthread_mutex_lock(&r->handoff);
+        const u8 result = actor_transfer(r, worker, n, d, &value);
+        pthread_mutex_unlock(&r->handoff);
+
+        if (result == TRANSFER_BLOCKED)
+            return;
+
+        block_finish_transfer(b, d, result, value);
+        b->waiting_ticks = 0;
+        a->steps++;
+    }
+
+    pthread_mutex_lock(&r->handoff);
+    actor_wake(r, worker, n, false);
+    pthread_mutex_unlock(&r->handoff);
+}
+
+static void *actor_work(void *arg)
+{
+    const actor_worker *w = arg;
+    actor_run *r = w->run;
+
+    while (true)
+    {
+        u8 n;
+        bool found = deque_pop(&r->deques[w->worker], &n);
+
+        for (u16 k = 1; k < r->workers && !found; k++)
+            found = deque_steal(&r->deques[(w->worker + k) % r->workers], &n);
+
+        if (!found)
+        {
+            if (atomic_load(&r->pending) == 0)
+                return NULL;
+            sched_yield();
+            continue;
+        }
+
+        actor_run_block(r, w->worker, n);
+        atomic_fetch_sub(&r->pending, 1);
+    }
+}
+
+// blocks sharing a self-modifying program write to each other's instructions, they cannot run on different threads
+static bool actors_share_writes(const grid *g)
+{
+    const u16 total = g->width * g->height;
+
+    for (u16 n = 0; n < total; n++)
+        for (u16 other = n + 1; other < total && g->blocks[n].self_modifying; other++)
+            if (g->blocks[other].bytecode == g->blocks[n].bytecode)
+                return true;
+    return false;
+}
+
+grid_status run_grid_actors(grid *g, u32 max_steps, int threads)
+{
+    actor_run *r = malloc(sizeof(actor_run));
+    if (!r)
+        return run_grid(g, max_steps);
+
+    const u16 total = g->width * g->height;
+    history_release(g);
+
+    r->g = g;
+    r->max_steps = max_steps;
+    if (threads > ACTORS_MAX_THREADS)
+        threads = ACTORS_MAX_THREADS;
+    r->workers = threads < 1 || actors_share_writes(g) ? 1 : threads;
+    atomic_init(&r->pending, 0);
+    pthread_mutex_init(&r->handoff, NULL);
+
+    for (u16 w = 0; w < r->workers; w++)
+    {
+        pthread_mutex_init(&r->deques[w].lock, NULL);
+        r->deques[w].top = r->deques[w].bottom = 0;
+    }
+
+    u16 queued = 0;
+    for (u16 n = 0; n < total; n++)
+    {
+        block *b = &g->blocks[n];
+        memset(&r->actors[n], 0, sizeof(block_actor));
+
+        if (!b->bytecode || b->state_halted)
+        {
+            r->actors[n].state = ACTOR_HALTED;
+            continue;
+        }
+
+        // ticks owed or waited out make no difference here
+        if (b->fused_ticks)
+            b->current_instruction = b->fused_resume;
+        b->fused_ticks = 0;
+        b->waiting_ticks = 0;
+        b->parked = false;
+        b->watchers = 0;
+
+        atomic_fetch_add(&r->pending, 1);
+        deque_push(&r->deques[queued++ % r->workers], n);
+    }
+
+    pthread_t started[ACTORS_MAX_THREADS];
+    actor_worker workers[ACTORS_MAX_THREADS];
+    u16 running = 0;
+
+    for (u16 w = 0; w < r->workers; w++)
+        workers[w] = (actor_worker){.run = r, .worker = w};
+
+    // the calling thread is worker 0, actors left on the deque of a thread that did not start get stolen
+    for (u16 w = 1; w < r->workers; w++)
+        if (!pthread_create(&started[running], NULL, actor_work, &workers[w]))
+            running++;
+
+    actor_work(&workers[0]);
+    for (u16 w = 0; w < running; w++)
+        pthread_join(started[w], NULL);
+
+    grid_status status = GRID_IDLE;
+    u32 steps = 0;
+
+    for (u16 n = 0; n < total; n++)
+    {
+        const block_actor *a = &r->actors[n];
+        block *b = &g->blocks[n];
+
+        if (a->steps > steps)
+            steps = a->steps;
+
+        if (a->state == ACTOR_STOPPED)
+            status = GRID_TICK_LIMIT;
+        else if (a->state == ACTOR_BLOCKED && status == GRID_IDLE)
+            status = GRID_DEADLOCK;
+
+        // what print_deadlock follows
+        b->parked = a->state == ACTOR_BLOCKED && a->side != any && g->links[n].neighbour[a->side];
+    }
+
+    for (u16 w = 0; w < r->workers; w++)
+        pthread_mutex_destroy(&r->deques[w].lock);
+    pthread_mutex_destroy(&r->handoff);
+    free(r);
+
+    g->ticks += steps;
+    g->max_ticks = max_steps;
+    g->any_ticked = status != GRID_IDLE;
+    g->live_dirty = true;
+    return status;
+}
@@ -0,0 +1,402 @@
+#include <string.h>
+
+#include "../include/analysis.h"
+
+// forward part of the facts at one address
+typedef struct
+{
+    u8 stack_min, stack_max;
+    u8 known;
+    u8 value[FACT_VALUES];
+} abstract_state;
+
+static const abstract_state state_top = {.stack_min = 0, .stack_max = 16};
+
+static bool analysis_decodable(const u8 *bytecode, u8 length, u8 pc)
+{
+    return pc + instruction_operand_bytes(((const instruction *)bytecode)[pc]) < length;
+}
+
+// folds b into a, true if a changed
+static bool state_join(abstract_state *a, const abstract_state *b)
+{
+    const abstract_state before = *a;
+
+    if (b->stack_min < a->stack_min)
+        a->stack_min = b->stack_min;
+    if (b->stack_max > a->stack_max)
+        a->stack_max = b->stack_max;
+
+    a->known &= b->known;
+    for (u8 n = 0; n < FACT_VALUES; n++)
+        if (a->value[n] != b->value[n])
+            a->known &= ~(1 << n);
+
+    return memcmp(&before, a, sizeof(abstract_state)) != 0;
+}
+
+static void state_set(abstract_state *s, u8 n, bool known, u8 value)
+{
+    if (known)
+    {
+        s->known |= 1 << n;
+        s->value[n] = value;
+    }
+    else
+    {
+        s->known &= ~(1 << n);
+        s->value[n] = 0; // joins compare values, keep unknown ones equal
+    }
+}
+
+// value the target of a reading instruction has, false if it is not known
+static bool state_operand(const abstract_state *s, const decoded_instruction *d, u8 pc, u8 *value)
+{
+    if (d->flags & DECODED_IO)
+        return false;
+
+    switch (d->target)
+    {
+    case ACC:
+    case RG0:
+    case RG1:
+    case RG2:
+    case RG3:;
+        const u8 n = d->target == ACC ? FACT_ACC : FACT_RG0 + d->target - RG0;
+        *value = s->value[n];
+        return s->known & (1 << n);
+    case ADJ:
+        *value = d->immediate;
+        return true;
+    case NIL:
+        *value = 0;
+        return true;
+    case CUR:
+        *value = pc;
+        return true;
+    case SLN:
+        *value = s->stack_min;
+        return s->stack_min == s->stack_max;
+    }
+    return false;
+}
+
+static bool analysis_arithmetic(u8 operation, u8 acc, u8 v, u8 *result)
+{
+    switch (operation)
+    {
+    case ADD:
+        *result = acc + v;
+        return true;
+    case SUB:
+        *result = acc - v;
+        return true;
+    case MLT:
+        *result = acc * v;
+        return true;
+    case DIV:
+        *result = v ? acc / v : acc;
+        return true;
+    case MOD:
+        *result = v ? acc % v : acc;
+        return true;
+    }
+    return false;
+}
+
+static bool analysis_extended(u8 ext_opcode, u8 acc, u8 v, u8 *result)
+{
+    const u8 shift = acc & 0x07;
+
+    switch (ext_opcode)
+    {
+    case EXT_XOR:
+        *result = acc ^ v;
+        return true;
+    case EXT_AND:
+        *result = acc & v;
+        return true;
+    case EXT_OR:
+        *result = acc | v;
+        return true;
+    case EXT_NOT:
+        *result = ~v;
+        return true;
+    case EXT_SHL:
+        *result = v << shift;
+        return true;
+    case EXT_SHR:
+        *result = v >> shift;
+        return true;
+    case EXT_ROL:
+        *result = (v << shift) | (v >> (8 - shift));
+        return true;
+    case EXT_ROR:
+        *result = (v >> shift) | (v << (8 - shift));
+        return true;
+    }
+    return false;
+}
+
+// state after d ran once, the same whether or not a transfer went through since blocked ones still run
+static abstract_state analysis_transfer(const abstract_state *in, const decoded_instruction *d, u8 pc)
+{
+    abstract_state out = *in;
+    const bool acc_known = in->known & (1 << FACT_ACC);
+    const u8 acc = in->value[FACT_ACC];
+    u8 v = 0;
+
+    if (d->operation == HALT)
+        return out;
+
+    if (d->flags & DECODED_WRITING)
+    {
+        const bool known = d->operation == PUT && acc_known;
+
+        if (d->operation == POP)
+        {
+            out.stack_min = out.stack_min ? out.stack_min - 1 : 0;
+            out.stack_max = out.stack_max ? out.stack_max - 1 : 0;
+        }
+
+        if (d->flags & DECODED_IO)
+            return out;
+
+        if (d->target == ACC)
+            state_set(&out, FACT_ACC, known, acc);
+        else if (d->target >= RG0 && d->target <= RG3)
+            state_set(&out, FACT_RG0 + d->target - RG0, known, acc);
+        return out;
+    }
+
+    const bool v_known = state_operand(in, d, pc, &v);
+    u8 result = 0;
+    bool known;
+
+    switch (d->operation)
+    {
+    case EXT:
+        if (d->ext_opcode >= EXT_GUARD_LAST)
+            break; // ACC stays as it is
+        known = (acc_known || d->ext_opcode == EXT_NOT) && v_known && analysis_extended(d->ext_opcode, acc, v, &result);
+        state_set(&out, FACT_ACC, known, result);
+        break;
+    case ADD:
+    case SUB:
+    case MLT:
+    case DIV:
+    case MOD:
+        if (v_known && v == 0 && (d->operation == DIV || d->operation == MOD))
+            break; // ACC stays as it is
+        known = acc_known && v_known && analysis_arithmetic(d->operation, acc, v, &result);
+        state_set(&out, FACT_ACC, known, result);
+        break;
+    case GET:
+        state_set(&out, FACT_ACC, v_known, v);
+        break;
+    case PUSH:
+        if (out.stack_min < 16)
+            out.stack_min++;
+        if (out.stack_max < 16)
+            out.stack_max++;
+        break;
+    }
+
+    return out;
+}
+
+/*
+    addresses the pc can be at after d, clamped like the interpreter does. sets *everywhere instead when the
+    destination is computed from something unknown
+*/
+static u8 analysis_successors(const abstract_state *in, const decoded_instruction *d, u8 pc, u8 length, u8 *next,
+                              bool *everywhere)
+{
+    u8 count = 0;
+    *everywhere = false;
+
+    if (d->operation == HALT)
+        return 0;
+
+    if (d->flags & DECODED_IO) // a blocked transfer runs again
+        next[count++] = pc;
+
+    const u8 fallthrough = pc + d->length;
+    const bool acc_known = in->known & (1 << FACT_ACC);
+    const bool is_jump = d->operation >= JMP && d->operation <= JOF;
+
+    bool falls = d->operation != JMP;
+    bool jumps = is_jump;
+
+    if (acc_known && d->operation == JEZ)
+        falls = !(jumps = in->value[FACT_ACC] == 0);
+    else if (acc_known && d->operation == JNZ)
+        falls = !(jumps = in->value[FACT_ACC] != 0);
+
+    if (falls)
+        next[count++] = fallthrough >= length ? length - 1 : fallthrough;
+
+    if (jumps)
+    {
+        u8 target;
+        if (!state_operand(in, d, pc, &target))
+            *everywhere = true;
+        else
+            next[count++] = target >= length ? length - 1 : target;
+    }
+
+    return count;
+}
+
+static void analysis_give_up(u8 length, program_facts *out)
+{
+    out->exact = false;
+    out->sides = SIDES_ALL;
+
+    for (u16 pc = 0; pc < length; pc++)
+        out->pc[pc] = (pc_facts){
+            .reachable = true,
+            .stack_max = 16,
+            .overflow_live = true,
+            .overflow_live_out = true,
+        };
+}
+
+// d reads last_caused_overflow as it was before d, a JOF through REF sees the flag the REF read just set
+static bool analysis_reads_overflow(const decoded_instruction *d)
+{
+    return d->operation == JOF && d->target != REF;
+}
+
+// d overwrites last_caused_overflow whatever happens, the other places that set it only ever set it to true
+static bool analysis_kills_overflow(const decoded_instruction *d)
+{
+    if (d->operation == HALT)
+        return false;
+    return d->target == REF || (d->operation >= ADD && d->operation <= MOD);
+}
+
+void analyze_program(const u8 *bytecode, u8 length, program_facts *out)
+{
+    memset(out, 0, sizeof(program_facts));
+
+    if (!length)
+        return;
+
+    for (u16 pc = 0; pc < length; pc++)
+    {
+        const instruction i = ((const instruction *)bytecode)[pc];
+        if ((i.operation == PUT || i.operation == POP) && (i.target == REF || i.target == ADJ))
+        {
+            analysis_give_up(length, out);
+            return;
+        }
+    }
+
+    out->exact = true;
+
+    abstract_state state[256];
+    u8 worklist[256];
+    bool queued[256] = {0};
+    u16 pending = 0;
+
+    state[0] = (abstract_state){.known = (1 << FACT_VALUES) - 1}; // load_program zeroes the block
+    out->pc[0].reachable = true;
+    worklist[pending++] = 0;
+    queued[0] = true;
+
+    while (pending)
+    {
+        const u8 pc = worklist[--pending];
+        queued[pc] = false;
+
+        abstract_state after = state_top;
+        u8 next[3];
+        u8 count = 0;
+        bool everywhere = true;
+
+        if (analysis_decodable(bytecode, length, pc))
+        {
+            const decoded_instruction d = decode_instruction(bytecode, pc);
+            after = analysis_transfer(&state[pc], &d, pc);
+            count = analysis_successors(&state[pc], &d, pc, length, next, &everywhere);
+        }
+
+        for (u16 n = 0; n < (everywhere ? length : count); n++)
+        {
+            const u8 to = everywhere ? n : next[n];
+            bool changed = false;
+
+            if (!out->pc[to].reachable)
+            {
+                out->pc[to].reachable = true;
+                state[to] = after;
+                changed = true;
+            }
+            else
+                changed = state_join(&state[to], &after);
+
+            if (changed && !queued[to])
+            {
+                worklist[pending++] = to;
+                queued[to] = true;
+            }
+        }
+    }
+
+    // overflow liveness, backwards until nothing changes
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+
+        for (i16 pc = length - 1; pc >= 0; pc--)
+        {
+            pc_facts *f = &out->pc[pc];
+            if (!f->reachable)
+                continue;
+
+            bool live_out = false;
+            bool live_in = true;
+
+            if (analysis_decodable(bytecode, length, pc))
+            {
+                const decoded_instruction d = decode_instruction(bytecode, pc);
+                u8 next[3];
+                bool everywhere;
+                const u8 count = analysis_successors(&state[pc], &d, pc, length, next, &everywhere);
+
+                for (u16 n = 0; n < (everywhere ? length : count) && !live_out; n++)
+                    live_out = out->pc[everywhere ? n : next[n]].overflow_live;
+
+                live_in = analysis_reads_overflow(&d) || (!analysis_kills_overflow(&d) && live_out);
+            }
+            else
+                live_out = true;
+
+            if (live_in != f->overflow_live || live_out != f->overflow_live_out)
+            {
+                f->overflow_live = live_in;
+                f->overflow_live_out = live_out;
+                changed = true;
+            }
+        }
+    }
+
+    for (u16 pc = 0; pc < length; pc++)
+    {
+        pc_facts *f = &out->pc[pc];
+        if (!f->reachable)
+            continue;
+
+        f->stack_min = state[pc].stack_min;
+        f->stack_max = state[pc].stack_max;
+        f->known = state[pc].known;
+        memcpy(f->value, state[pc].value, sizeof(f->value));
+
+        // neighbours go by the target alone, so a HALT UP still looks like a read from up until it runs
+        const instruction i = ((const instruction *)bytecode)[pc];
+        if (i.target >= UP && i.target <= ANY)
+            out->sides |= 1 << (up + i.target - UP);
+    }
+}
@@ -3,7 +3,30 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "../include/analysis.h"
 #include "../include/definitions.h"
+#include "../include/history.h"
+#include "../include/jit.h"
+#include "../include/native.h"
+#include "../include/verify.h"
+
+// neighbours and edge slots of every block, transfers look them up instead of working them out each time
+static void grid_link_blocks(grid *g)
+{
+    for (u8 y = 0; y < g->height; y++)
+        for (u8 x = 0; x < g->width; x++)
+        {
+            block_links *l = &g->links[y * g->width + x];
+
+            l->neighbour[up] = y != 0 ? &g->blocks[(y - 1) * g->width + x] : NULL;
+            l->neighbour[down] = y != g->height - 1 ? &g->blocks[(y + 1) * g->width + x] : NULL;
+            l->neighbour[left] = x != 0 ? &g->blocks[y * g->width + x - 1] : NULL;
+            l->neighbour[right] = x != g->width - 1 ? &g->blocks[y * g->width + x + 1] : NULL;
+
+            for (side s = up; s <= left; s++)
+                l->slot[s] = l->neighbour[s] ? NULL : &g->slots[io_slot_offset(g, s, s == up || s == down ? x : y)];
+        }
+}
 
 grid *initialize_grid(u8 w, u8 h)
 {
@@ -24,14 +47,72 @@ grid *initialize_grid(u8 w, u8 h)
     g->total_blocks = total_blocks;
     g->perimeter = edge_length;
 
+    grid_link_blocks(g);
+
     return g;
 }
 
 void free_grid(grid *g)
 {
+    for (u16 n = 0; n < g->width * g->height; n++)
+    {
+        jit_release_block(&g->blocks[n]);
+        native_release_block(&g->blocks[n]);
+    }
+    native_release_grid(g);
+    history_release(g);
+
     free(g);
 }
 
+void copy_grid(grid *dst, const grid *src)
+{
+    assert(dst->width == src->width && dst->height == src->height);
+
+    native_release_grid(dst);
+    history_release(dst);
+
+    for (u16 n = 0; n < src->width * src->height; n++)
+    {
+        block *d = &dst->blocks[n];
+        const block *s = &src->blocks[n];
+
+        // the code of a program that never writes to itself stays good for as long as the block runs it
+        struct block_jit *jit = d->jit;
+        if (jit && (d->bytecode != s->bytecode || s->self_modifying))
+        {
+            jit_release_block(d);
+            jit = NULL;
+        }
+        native_release_block(d);
+
+        *d = *s;
+        d->jit = jit;
+        d->native = NULL;
+    }
+
+    memcpy(dst->slots, src->slots, src->perimeter * sizeof(io_slot));
+    memcpy(dst->live, src->live, src->live_count * sizeof(live_block));
+    memcpy(dst->intents, src->intents, src->width * src->height * sizeof(block_intent));
+
+    dst->any_ticked = src->any_ticked;
+    dst->debug = src->debug;
+    dst->fuse = src->fuse;
+    dst->jit = src->jit;
+    dst->trace = src->trace;
+    dst->batch = src->batch;
+    dst->cycles = src->cycles;
+    dst->prune = src->prune;
+    dst->checkpoints = src->checkpoints;
+    dst->two_phase = src->two_phase;
+    dst->ticks = src->ticks;
+    dst->max_ticks = src->max_ticks;
+    dst->live_count = src->live_count;
+    dst->parked_count = src->parked_count;
+    dst->live_dirty = src->live_dirty;
+    dst->soonest_wake = src->soonest_wake;
+}
+
 u16 io_slot_offset(const grid *g, const u8 side, const u8 slot)
 {
     assert(side < 4);
@@ -64,6 +145,7 @@ void slot_set_length(grid*g, u8 side, u8 slot, u8 len)
     io_slot *s = &g->slots[offset];
 
     s->len = len;
+    g->live_dirty = true; // outputs decide which blocks are pruned
 }
 
 u8* attach_input(grid *g, u8 side, u8 slot)
@@ -74,6 +156,7 @@ u8* attach_input(grid *g, u8 side, u8 slot)
 
     s->read_only = true;
     s->cur = 0;
+    g->live_dirty = true;
 
     return s->bytes;
 }
@@ -86,6 +169,7 @@ u8* attach_output(grid *g, u8 side, u8 slot)
 
     s->read_only = false;
     s->cur = 0;
+    g->live_dirty = true;
 
     return s->bytes;
 }
@@ -94,10 +178,22 @@ void load_program(grid *g, u8 x, u8 y, const void *bytecode, u8 length)
 {
     block *b = &g->blocks[y * g->width + x];
 
+    native_release_grid(g); // wiring and programs were baked into it
+    history_release(g);     // checkpoints hold the block as it was
+    jit_release_block(b);
+    native_release_block(b);
     memset(b, 0, sizeof(block));
+    g->live_dirty = true;
 
     b->bytecode = (void *)bytecode;
     b->length = length;
     b->stack_top = -1;
     b->current_instruction = 0;
+
+    block_decode_program(b);
+    b->verified = verify_program(bytecode, length);
+
+    program_facts facts;
+    analyze_program(bytecode, length, &facts);
+    b->sides_used = facts.sides;
 }
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/batch.h"
+
+typedef struct
+{
+    const grid *template;
+    u32 records;
+    u32 max_ticks;
+    batch_fill_fn fill;
+    batch_collect_fn collect;
+    void *context;
+
+    u32 next; // first record no thread has taken yet
+    pthread_mutex_t taking;
+
+    // self-modifying programs of the template, every thread runs its own copies of them
+    const instruction *programs[256];
+    u8 lengths[256];
+    u16 program_count;
+    u8 program_of[256]; // index into programs for the blocks running one of them
+} batch_run;
+
+static void batch_find_programs(batch_run *r)
+{
+    const grid *t = r->template;
+    r->program_count = 0;
+
+    for (u16 n = 0; n < t->width * t->height; n++)
+    {
+        const block *b = &t->blocks[n];
+        if (!b->bytecode || !b->self_modifying)
+            continue;
+
+        u16 p = 0;
+        while (p < r->program_count && r->programs[p] != b->bytecode)
+            p++;
+        if (p == r->program_count)
+        {
+            r->programs[p] = b->bytecode;
+            r->lengths[p] = b->length;
+            r->program_count++;
+        }
+        r->program_of[n] = p;
+    }
+}
+
+static void *batch_work(void *arg)
+{
+    batch_run *r = arg;
+    const grid *t = r->template;
+    grid *g = initialize_grid(t->width, t->height);
+
+    u8(*programs)[256] = NULL;
+    if (r->program_count)
+    {
+        programs = malloc(r->program_count * sizeof(*programs));
+        assert(programs != 0);
+    }
+
+    while (true)
+    {
+        pthread_mutex_lock(&r->taking);
+        const u32 record = r->next < r->records ? r->next++ : r->records;
+        pthread_mutex_unlock(&r->taking);
+
+        if (record == r->records)
+            break;
+
+        copy_grid(g, t);
+
+        // bytes past the end can be written too, they start out as zero for every record
+        for (u16 p = 0; p < r->program_count; p++)
+        {
+            memcpy(programs[p], r->programs[p], r->lengths[p]);
+            memset(programs[p] + r->lengths[p], 0, 256 - r->lengths[p]);
+        }
+
+        for (u16 n = 0; n < t->width * t->height && r->program_count; n++)
+            if (t->blocks[n].bytecode && t->blocks[n].self_modifying)
+                g->blocks[n].bytecode = (const instruction *)programs[r->program_of[n]];
+
+        r->fill(g, record, r->context);
+        const grid_status status = run_grid(g, r->max_ticks);
+        r->collect(g, record, status, r->context);
+    }
+
+    free(programs);
+    free_grid(g);
+    return NULL;
+}
+
+void run_grid_batch(const grid *template, u32 records, u32 max_ticks, int threads, batch_fill_fn fill,
+                    batch_collect_fn collect, void *context)
+{
+    batch_run r = {
+        .template = template,
+        .records = records,
+        .max_ticks = max_ticks,
+        .fill = fill,
+        .collect = collect,
+        .context = context,
+        .next = 0,
+    };
+    batch_find_programs(&r);
+    pthread_mutex_init(&r.taking, NULL);
+
+    u32 workers = threads < 1 ? 1 : threads;
+    if (workers > records)
+        workers = records;
+    if (workers > BATCH_MAX_THREADS)
+        workers = BATCH_MAX_THREADS;
+
+    // the calling thread is one of them, records that would have gone to a thread that did not start go to the others
+    pthread_t started[BATCH_MAX_THREADS];
+    u16 running = 0;
+    for (u32 n = 1; n < workers; n++)
+        if (!pthread_create(&started[running], NULL, batch_work, &r))
+            running++;
+
+    batch_work(&r);
+    for (u16 n = 0; n < running; n++)
+        pthread_join(started[n], NULL);
+    pthread_mutex_destroy(&r.taking);
+}
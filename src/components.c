@@ -0,0 +1,234 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/components.h"
+
+static u16 component_root(u16 *parent, u16 n)
+{
+    while (parent[n] != n)
+        n = parent[n] = parent[parent[n]];
+    return n;
+}
+
+static void component_join(u16 *parent, u16 a, u16 b)
+{
+    a = component_root(parent, a);
+    b = component_root(parent, b);
+    if (a < b)
+        parent[b] = a;
+    else
+        parent[a] = b;
+}
+
+u16 grid_find_components(const grid *g, u16 *component)
+{
+    const u16 total = g->width * g->height;
+    u16 parent[256];
+
+    for (u16 n = 0; n < total; n++)
+        parent[n] = n;
+
+    for (u16 n = 0; n < total; n++)
+    {
+        const block *b = &g->blocks[n];
+        if (!b->bytecode)
+            continue;
+
+        for (side s = up; s <= left; s++)
+        {
+            const block *peer = g->links[n].neighbour[s];
+            if (peer && peer->bytecode && (b->sides_used & ((1 << s) | (1 << any))))
+                component_join(parent, n, peer - g->blocks);
+        }
+
+        if (b->self_modifying)
+            for (u16 other = n + 1; other < total; other++)
+                if (g->blocks[other].bytecode == b->bytecode)
+                    component_join(parent, n, other);
+    }
+
+    // roots are the lowest index in their component, so numbering them in order numbers the components in order
+    u16 count = 0;
+    for (u16 n = 0; n < total; n++)
+    {
+        if (!g->blocks[n].bytecode)
+            component[n] = 0;
+        else if (component_root(parent, n) == n)
+            component[n] = ++count;
+        else
+            component[n] = component[component_root(parent, n)];
+    }
+
+    return count;
+}
+
+typedef struct
+{
+    grid *g;
+    u32 max_ticks;
+    u16 component_of[256];
+    u16 count;
+    u16 next; // first component no thread has taken yet
+    pthread_mutex_t taking;
+    grid_status status[257];
+    u32 ticks[257];
+    bool live[256]; // blocks the components left live
+    u16 parked;
+} component_run;
+
+// runs component c of r->g in sub, which is a grid of the same size, then copies what it changed back
+static void component_run_one(component_run *r, grid *sub, u16 c)
+{
+    grid *g = r->g;
+    const u16 total = g->width * g->height;
+
+    sub->debug = g->debug;
+    sub->fuse = g->fuse;
+    sub->jit = g->jit;
+    sub->trace = g->trace;
+    sub->batch = g->batch;
+    sub->cycles = g->cycles;
+    sub->prune = g->prune;
+    sub->two_phase = g->two_phase;
+    sub->ticks = g->ticks;
+
+    // other threads are writing back the slots of their own components meanwhile, only this one's are copied
+    for (u16 n = 0; n < total; n++)
+    {
+        if (r->component_of[n] != c)
+        {
+            memset(&sub->blocks[n], 0, sizeof(block));
+            continue;
+        }
+
+        sub->blocks[n] = g->blocks[n];
+        for (side s = up; s <= left; s++)
+        {
+            const io_slot *slot = g->links[n].slot[s];
+            if (slot)
+                sub->slots[slot - g->slots] = *slot;
+        }
+    }
+
+    // the part of the live list that is this component's keeps going as it is, parked blocks included
+    sub->live_dirty = g->live_dirty;
+    sub->live_count = 0;
+    sub->parked_count = 0;
+    for (u16 i = 0; i < g->live_count && !g->live_dirty; i++)
+        if (r->component_of[g->live[i].index] == c)
+        {
+            sub->live[sub->live_count++] = g->live[i];
+            sub->parked_count += g->blocks[g->live[i].index].parked;
+        }
+
+    r->status[c] = run_grid(sub, r->max_ticks);
+    r->ticks[c] = sub->ticks;
+
+    for (u16 n = 0; n < total; n++)
+    {
+        if (r->component_of[n] != c)
+            continue;
+
+        g->blocks[n] = sub->blocks[n];
+        sub->blocks[n].jit = NULL; // g's block owns them again
+        sub->blocks[n].native = NULL;
+
+        for (side s = up; s <= left; s++)
+        {
+            const io_slot *slot = g->links[n].slot[s];
+            if (slot)
+                g->slots[slot - g->slots] = sub->slots[slot - g->slots];
+        }
+    }
+
+    pthread_mutex_lock(&r->taking);
+    for (u16 i = 0; i < sub->live_count; i++)
+        r->live[sub->live[i].index] = true;
+    r->parked += sub->parked_count;
+    pthread_mutex_unlock(&r->taking);
+}
+
+static void *component_work(void *arg)
+{
+    component_run *r = arg;
+    grid *sub = initialize_grid(r->g->width, r->g->height);
+
+    while (true)
+    {
+        pthread_mutex_lock(&r->taking);
+        const u16 c = r->next <= r->count ? r->next++ : 0;
+        pthread_mutex_unlock(&r->taking);
+
+        if (!c)
+            break;
+
+        component_run_one(r, sub, c);
+    }
+
+    free_grid(sub);
+    return NULL;
+}
+
+grid_status run_grid_components(grid *g, u32 max_ticks, int threads)
+{
+    component_run *r = malloc(sizeof(component_run));
+    if (!r)
+        return run_grid(g, max_ticks);
+
+    r->count = grid_find_components(g, r->component_of);
+    if (g->native || g->checkpoints || r->count < 2 || threads < 2)
+    {
+        free(r);
+        return run_grid(g, max_ticks);
+    }
+
+    r->g = g;
+    r->max_ticks = max_ticks;
+    r->next = 1;
+    r->parked = 0;
+    memset(r->live, 0, sizeof(r->live));
+    pthread_mutex_init(&r->taking, NULL);
+
+    u16 workers = threads < r->count ? threads : r->count;
+    if (workers > COMPONENTS_MAX_THREADS)
+        workers = COMPONENTS_MAX_THREADS;
+
+    // the calling thread is one of them, components wait for whichever thread is free first
+    pthread_t started[COMPONENTS_MAX_THREADS];
+    u16 running = 0;
+    for (u16 n = 1; n < workers; n++)
+        if (!pthread_create(&started[running], NULL, component_work, r))
+            running++;
+
+    component_work(r);
+    for (u16 n = 0; n < running; n++)
+        pthread_join(started[n], NULL);
+    pthread_mutex_destroy(&r->taking);
+
+    grid_status status = GRID_IDLE;
+    u32 ticks = 0;
+    for (u16 c = 1; c <= r->count; c++)
+    {
+        if (r->status[c] == GRID_TICK_LIMIT || (r->status[c] == GRID_DEADLOCK && status == GRID_IDLE))
+            status = r->status[c];
+        if (r->ticks[c] > ticks)
+            ticks = r->ticks[c];
+    }
+
+    g->ticks = ticks;
+    g->max_ticks = max_ticks;
+    g->any_ticked = status != GRID_IDLE;
+    g->live_count = 0;
+    g->parked_count = r->parked;
+    g->live_dirty = false;
+    g->soonest_wake = 0;
+
+    for (u8 y = 0; y < g->height; y++)
+        for (u8 x = 0; x < g->width; x++)
+            if (r->live[y * g->width + x])
+                g->live[g->live_count++] = (live_block){.index = y * g->width + x, .x = x, .y = y};
+
+    free(r);
+    return status;
+}
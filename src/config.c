@@ -62,6 +62,66 @@ bool parse_config(const char *filename, vm_config *config)
         config->print_strings = cJSON_IsTrue(print_strings);
     }
     
+    cJSON *jit = cJSON_GetObjectItem(root, "jit");
+    if (cJSON_IsBool(jit))
+    {
+        config->jit = cJSON_IsTrue(jit);
+    }
+    
+    cJSON *prune = cJSON_GetObjectItem(root, "prune");
+    if (cJSON_IsBool(prune))
+    {
+        config->prune = cJSON_IsTrue(prune);
+    }
+    
+    cJSON *cycles = cJSON_GetObjectItem(root, "cycles");
+    if (cJSON_IsBool(cycles))
+    {
+        config->cycles = cJSON_IsTrue(cycles);
+    }
+    
+    cJSON *fuse = cJSON_GetObjectItem(root, "fuse");
+    if (cJSON_IsBool(fuse))
+    {
+        config->fuse = cJSON_IsTrue(fuse);
+    }
+    
+    cJSON *trace = cJSON_GetObjectItem(root, "trace");
+    if (cJSON_IsBool(trace))
+    {
+        config->trace = cJSON_IsTrue(trace);
+    }
+    
+    cJSON *batch = cJSON_GetObjectItem(root, "batch");
+    if (cJSON_IsBool(batch))
+    {
+        config->batch = cJSON_IsTrue(batch);
+    }
+    
+    cJSON *compiled = cJSON_GetObjectItem(root, "compiled");
+    if (cJSON_IsBool(compiled))
+    {
+        config->compiled = cJSON_IsTrue(compiled);
+    }
+    
+    cJSON *two_phase = cJSON_GetObjectItem(root, "two_phase");
+    if (cJSON_IsBool(two_phase))
+    {
+        config->two_phase = cJSON_IsTrue(two_phase);
+    }
+    
+    cJSON *threads = cJSON_GetObjectItem(root, "threads");
+    if (cJSON_IsNumber(threads) && threads->valueint > 0)
+    {
+        config->threads = threads->valueint > 255 ? 255 : (u8)threads->valueint;
+    }
+    
+    cJSON *actors = cJSON_GetObjectItem(root, "actors");
+    if (cJSON_IsBool(actors))
+    {
+        config->actors = cJSON_IsTrue(actors);
+    }
+    
     cJSON *programs = cJSON_GetObjectItem(root, "programs");
     if (cJSON_IsObject(programs))
     {
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/history.h"
+
+static void history_take(grid *g, grid_checkpoint *c)
+{
+    c->ticks = g->ticks;
+    c->live_count = g->live_count;
+    c->parked_count = g->parked_count;
+    c->soonest_wake = g->soonest_wake;
+    memcpy(c->live, g->live, g->live_count * sizeof(live_block));
+
+    for (u16 n = 0; n < (g->width + g->height) * 2; n++)
+    {
+        c->cur[n] = g->slots[n].cur;
+        c->ended[n] = g->slots[n].ended;
+    }
+
+    for (u16 n = 0; n < g->width * g->height; n++)
+    {
+        const block *b = &g->blocks[n];
+        block_checkpoint *s = &c->blocks[n];
+
+        s->current_instruction = b->current_instruction;
+        memcpy(s->registers, b->registers, sizeof(s->registers));
+        s->accumulator = b->accumulator;
+        memcpy(s->stack, b->stack, sizeof(s->stack));
+        s->stack_top = b->stack_top;
+        s->waiting_ticks = b->waiting_ticks;
+        s->transfer_value = b->transfer_value;
+        s->io_blocked = b->io_blocked;
+        s->state_halted = b->state_halted;
+        s->parked = b->parked;
+        s->watchers = b->watchers;
+        s->last_caused_overflow = b->last_caused_overflow;
+        s->fused_ticks = b->fused_ticks;
+        s->fused_resume = b->fused_resume;
+    }
+}
+
+static void history_put_back(grid *g, const grid_checkpoint *c)
+{
+    g->ticks = c->ticks;
+    g->live_count = c->live_count;
+    g->parked_count = c->parked_count;
+    g->soonest_wake = c->soonest_wake;
+    memcpy(g->live, c->live, c->live_count * sizeof(live_block));
+
+    for (u16 n = 0; n < g->width * g->height; n++)
+    {
+        block *b = &g->blocks[n];
+        const block_checkpoint *s = &c->blocks[n];
+
+        b->current_instruction = s->current_instruction;
+        memcpy(b->registers, s->registers, sizeof(s->registers));
+        b->accumulator = s->accumulator;
+        memcpy(b->stack, s->stack, sizeof(s->stack));
+        b->stack_top = s->stack_top;
+        b->waiting_ticks = s->waiting_ticks;
+        b->transfer_value = s->transfer_value;
+        b->io_blocked = s->io_blocked;
+        b->state_halted = s->state_halted;
+        b->parked = s->parked;
+        b->watchers = s->watchers;
+        b->last_caused_overflow = s->last_caused_overflow;
+        b->fused_ticks = s->fused_ticks;
+        b->fused_resume = s->fused_resume;
+
+        // a trace being replayed or recorded is somewhere else in the loop by now
+        b->trace.state = TRACE_IDLE;
+        b->trace.heat = 0;
+        b->trace.misses = 0;
+    }
+}
+
+void history_begin(grid *g, u32 max_ticks)
+{
+    if (!g->checkpoints)
+    {
+        history_release(g);
+        return;
+    }
+
+    if (!g->history && !(g->history = malloc(sizeof(struct grid_history))))
+        return;
+
+    struct grid_history *h = g->history;
+    h->recording = !g->native;
+    for (u16 n = 0; n < g->width * g->height && h->recording; n++)
+        h->recording = !g->blocks[n].bytecode || !g->blocks[n].self_modifying;
+
+    if (!h->recording)
+        return;
+
+    h->max_ticks = max_ticks;
+    h->interval = HISTORY_INTERVAL;
+    h->count = 1;
+    for (u16 n = 0; n < (g->width + g->height) * 2; n++)
+        g->slots[n].ended = false;
+    memcpy(h->slots, g->slots, sizeof(h->slots));
+    history_take(g, &h->checkpoints[0]);
+}
+
+void history_tick(grid *g)
+{
+    struct grid_history *h = g->history;
+    if (!h || !h->recording || g->ticks - h->checkpoints[h->count - 1].ticks < h->interval)
+        return;
+
+    if (h->count == HISTORY_CHECKPOINTS)
+    {
+        for (u16 n = 1; n < HISTORY_CHECKPOINTS / 2; n++)
+            h->checkpoints[n] = h->checkpoints[n * 2];
+        h->count = HISTORY_CHECKPOINTS / 2;
+        h->interval *= 2;
+
+        if (g->ticks - h->checkpoints[h->count - 1].ticks < h->interval)
+            return;
+    }
+
+    history_take(g, &h->checkpoints[h->count++]);
+}
+
+/*
+    index of the first byte that is not the same in was and now, or the shorter length if only the lengths differ.
+    returns false if nothing differs. output slots only count their length, their contents are what the run wrote
+*/
+static bool history_first_change(const io_slot *was, const io_slot *now, u16 *at)
+{
+    const u16 common = was->len < now->len ? was->len : now->len;
+
+    for (u16 n = 0; now->read_only && n < common; n++)
+        if (was->bytes[n] != now->bytes[n])
+        {
+            *at = n;
+            return true;
+        }
+
+    *at = common;
+    return was->len != now->len;
+}
+
+bool history_restore(grid *g)
+{
+    struct grid_history *h = g->history;
+    if (!h || !h->recording)
+        return false;
+
+    const u16 slots = (g->width + g->height) * 2;
+    bool changed[256] = {0};
+    u16 first_change[256];
+    bool pruning_changed = false; // an output slot got or lost its length, blocks left out until now may run
+
+    for (u16 n = 0; n < slots; n++)
+    {
+        if (h->slots[n].read_only != g->slots[n].read_only)
+            return false;
+        changed[n] = history_first_change(&h->slots[n], &g->slots[n], &first_change[n]);
+        pruning_changed |= g->prune && !g->slots[n].read_only && !h->slots[n].len != !g->slots[n].len;
+    }
+
+    // the byte at first_change must not have been read yet, nor the end of the slot found if that is where it is.
+    // the start of the run is always fine, whatever was read before it is no part of the run
+    i16 chosen = h->count - 1;
+    for (; chosen > 0; chosen--)
+    {
+        const grid_checkpoint *c = &h->checkpoints[chosen];
+        bool valid = !pruning_changed;
+
+        for (u16 n = 0; n < slots && valid; n++)
+            if (changed[n])
+                valid = c->cur[n] < first_change[n] || (c->cur[n] == first_change[n] && !c->ended[n]);
+
+        if (valid)
+            break;
+    }
+
+    const grid_checkpoint *c = &h->checkpoints[chosen];
+    history_put_back(g, c);
+    if (pruning_changed)
+        g->live_dirty = true;
+
+    for (u16 n = 0; n < slots; n++)
+    {
+        io_slot *s = &g->slots[n];
+        s->cur = c->cur[n];
+        s->ended = c->ended[n];
+
+        if (!s->read_only) // what the run wrote after the checkpoint goes, it may not be written again
+            memcpy(s->bytes + s->cur, h->slots[n].bytes + s->cur, sizeof(s->bytes) - s->cur);
+        else
+            memcpy(h->slots[n].bytes, s->bytes, sizeof(s->bytes));
+        h->slots[n].len = s->len;
+    }
+
+    h->count = chosen + 1;
+    return true;
+}
+
+void history_release(grid *g)
+{
+    free(g->history);
+    g->history = NULL;
+}
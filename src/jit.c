@@ -0,0 +1,370 @@
+#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/jit.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_WIN32)
+#include <windows.h>
+#define JIT_HOST 1
+#define JIT_BASE 1 // rcx holds the first argument
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define JIT_HOST 1
+#define JIT_BASE 7 // rdi holds the first argument
+#endif
+#endif
+
+#ifndef JIT_HOST
+#define JIT_HOST 0
+#endif
+
+bool jit_supported(void)
+{
+    return JIT_HOST;
+}
+
+void jit_release_block(block *b)
+{
+    if (!b->jit)
+        return;
+
+#if JIT_HOST && defined(_WIN32)
+    VirtualFree(b->jit->code, 0, MEM_RELEASE);
+#elif JIT_HOST
+    munmap(b->jit->code, b->jit->size);
+#endif
+
+    free(b->jit);
+    b->jit = NULL;
+}
+
+#if JIT_HOST
+
+/*
+    the generated code only uses the block pointer it gets as its argument, eax and edx, which are scratch
+    registers in both calling conventions, and never calls anything. every field it touches is addressed as
+    [base + disp8]
+*/
+
+#define JIT_MAX_TEMPLATE 48 // longest template below, with room to spare
+#define JIT_CODE_SIZE (256 * JIT_MAX_TEMPLATE)
+
+#define OFF_CUR offsetof(block, current_instruction)
+#define OFF_REGS offsetof(block, registers)
+#define OFF_ACC offsetof(block, accumulator)
+#define OFF_WAIT offsetof(block, waiting_ticks)
+#define OFF_BLOCKED offsetof(block, io_blocked)
+#define OFF_OVERFLOW offsetof(block, last_caused_overflow)
+
+static_assert(offsetof(block, last_caused_overflow) < 128, "fields must be reachable with disp8");
+
+enum
+{
+    EAX = 0,
+    EDX = 2,
+    AH = 4,
+};
+
+typedef struct
+{
+    u8 *code;
+    u32 at;
+} emitter;
+
+static void emit(emitter *e, u8 byte)
+{
+    e->code[e->at++] = byte;
+}
+
+static void emit_imm32(emitter *e, u32 value)
+{
+    for (u8 i = 0; i < 4; i++)
+        emit(e, value >> (i * 8));
+}
+
+// <opcode bytes> modrm(reg, [base + disp8]) disp8
+static void emit_mem(emitter *e, u8 opcode_len, const u8 *opcode, u8 reg, u8 disp)
+{
+    for (u8 i = 0; i < opcode_len; i++)
+        emit(e, opcode[i]);
+    emit(e, 0x40 | reg << 3 | JIT_BASE);
+    emit(e, disp);
+}
+
+static void emit_movzx_load(emitter *e, u8 reg, u8 disp) // movzx r32, byte [base + disp]
+{
+    emit_mem(e, 2, (const u8[]){0x0F, 0xB6}, reg, disp);
+}
+
+static void emit_store(emitter *e, u8 reg, u8 disp) // mov byte [base + disp], r8
+{
+    emit_mem(e, 1, (const u8[]){0x88}, reg, disp);
+}
+
+static void emit_store_imm(emitter *e, u8 disp, u8 value) // mov byte [base + disp], imm8
+{
+    emit_mem(e, 1, (const u8[]){0xC6}, 0, disp);
+    emit(e, value);
+}
+
+static void emit_cmp_zero(emitter *e, u8 disp) // cmp byte [base + disp], 0
+{
+    emit_mem(e, 1, (const u8[]){0x80}, 7, disp);
+    emit(e, 0);
+}
+
+static void emit_setcc(emitter *e, u8 cc, u8 disp) // setcc byte [base + disp]
+{
+    emit_mem(e, 2, (const u8[]){0x0F, cc}, 0, disp);
+}
+
+#define SETA 0x97
+#define SETB 0x92
+#define SETE 0x94
+#define JB 0x72
+#define JE 0x74
+#define JNE 0x75
+
+static bool jit_readable(u8 target)
+{
+    switch (target)
+    {
+    case ACC:
+    case RG0:
+    case RG1:
+    case RG2:
+    case RG3:
+    case ADJ:
+    case NIL:
+    case CUR:
+        return true;
+    }
+    return false;
+}
+
+static bool jit_supports(const decoded_instruction *d)
+{
+    if (!(d->flags & DECODED_VALID) || (d->flags & DECODED_IO))
+        return false;
+
+    switch (d->operation)
+    {
+    case WAIT:
+    case ADD:
+    case SUB:
+    case MLT:
+    case DIV:
+    case MOD:
+    case GET:
+    case JMP:
+    case JEZ:
+    case JNZ:
+    case JOF:
+        return jit_readable(d->target);
+    case EXT:
+        return jit_readable(d->target) && d->ext_opcode <= EXT_NOT;
+    case PUT:
+        return d->target == ACC || (d->target >= RG0 && d->target <= RG3) || d->target == NIL ||
+               d->target == SLN || d->target == CUR;
+    }
+    return false;
+}
+
+// operand of the instruction into edx
+static void emit_operand(emitter *e, const decoded_instruction *d, u8 pc)
+{
+    switch (d->target)
+    {
+    case ACC:
+        emit_movzx_load(e, EDX, OFF_ACC);
+        break;
+    case RG0:
+    case RG1:
+    case RG2:
+    case RG3:
+        emit_movzx_load(e, EDX, OFF_REGS + d->target - RG0);
+        break;
+    case ADJ:
+        emit(e, 0xBA); // mov edx, imm32
+        emit_imm32(e, d->immediate);
+        break;
+    case CUR:
+        emit(e, 0xBA);
+        emit_imm32(e, pc);
+        break;
+    default: // NIL
+        emit(e, 0xBA);
+        emit_imm32(e, 0);
+        break;
+    }
+}
+
+static void jit_emit_instruction(emitter *e, const block *b, const decoded_instruction *d, u8 pc)
+{
+    const u8 next = pc + d->length;
+
+    if (d->operation != PUT)
+        emit_operand(e, d, pc);
+
+    switch (d->operation)
+    {
+    case WAIT:
+        emit_store(e, EDX, OFF_WAIT);
+        break;
+    case ADD:
+        emit_movzx_load(e, EAX, OFF_ACC);
+        emit(e, 0x01), emit(e, 0xD0);                     // add eax, edx
+        emit(e, 0x3D), emit_imm32(e, 255);                // cmp eax, 255
+        emit_setcc(e, SETA, OFF_OVERFLOW);
+        emit_store(e, EAX, OFF_ACC);
+        break;
+    case SUB:
+        emit_movzx_load(e, EAX, OFF_ACC);
+        emit(e, 0x39), emit(e, 0xD0); // cmp eax, edx
+        emit_setcc(e, SETB, OFF_OVERFLOW);
+        emit(e, 0x29), emit(e, 0xD0); // sub eax, edx
+        emit_store(e, EAX, OFF_ACC);
+        break;
+    case MLT:
+        emit_movzx_load(e, EAX, OFF_ACC);
+        emit(e, 0x0F), emit(e, 0xAF), emit(e, 0xC2); // imul eax, edx
+        emit(e, 0x3D), emit_imm32(e, 255);
+        emit_setcc(e, SETA, OFF_OVERFLOW);
+        emit_store(e, EAX, OFF_ACC);
+        break;
+    case DIV:
+    case MOD:
+        emit_movzx_load(e, EAX, OFF_ACC);
+        emit(e, 0x84), emit(e, 0xD2); // test dl, dl
+        emit_setcc(e, SETE, OFF_OVERFLOW);
+        emit(e, JE), emit(e, 5);
+        emit(e, 0xF6), emit(e, 0xF2); // div dl: al = ax / dl, ah = ax % dl
+        emit_store(e, d->operation == DIV ? EAX : AH, OFF_ACC);
+        break;
+    case GET:
+        emit_store(e, EDX, OFF_ACC);
+        break;
+    case PUT:
+        if (d->target == ACC || (d->target >= RG0 && d->target <= RG3))
+        {
+            emit_movzx_load(e, EDX, OFF_ACC);
+            emit_store(e, EDX, d->target == ACC ? OFF_ACC : OFF_REGS + d->target - RG0);
+        }
+        break;
+    case EXT:
+        if (d->ext_opcode == EXT_NOT)
+        {
+            emit(e, 0xF6), emit(e, 0xD2); // not dl
+            emit_store(e, EDX, OFF_ACC);
+            break;
+        }
+        emit_movzx_load(e, EAX, OFF_ACC);
+        emit(e, d->ext_opcode == EXT_XOR ? 0x30 : d->ext_opcode == EXT_AND ? 0x20 : 0x08), emit(e, 0xD0); // op al, dl
+        emit_store(e, EAX, OFF_ACC);
+        break;
+    }
+
+    // al = where the pc goes
+    emit(e, 0xB0), emit(e, next); // mov al, next
+    switch (d->operation)
+    {
+    case JMP:
+        emit(e, 0x88), emit(e, 0xD0); // mov al, dl
+        break;
+    case JEZ:
+    case JNZ:
+        emit_cmp_zero(e, OFF_ACC);
+        emit(e, d->operation == JEZ ? JNE : JE), emit(e, 2);
+        emit(e, 0x88), emit(e, 0xD0);
+        break;
+    case JOF:
+        emit_cmp_zero(e, OFF_OVERFLOW);
+        emit(e, JE), emit(e, 6);
+        emit(e, 0x88), emit(e, 0xD0);
+        emit_store_imm(e, OFF_OVERFLOW, 0);
+        break;
+    }
+
+    // if (!b->io_blocked) b->current_instruction = al >= length ? length - 1 : al;
+    emit(e, 0x3C), emit(e, b->length); // cmp al, length
+    emit(e, JB), emit(e, 2);
+    emit(e, 0xB0), emit(e, b->length - 1);
+    emit_cmp_zero(e, OFF_BLOCKED);
+    emit(e, JNE), emit(e, 3);
+    emit_store(e, EAX, OFF_CUR);
+    emit(e, 0xC3); // ret
+}
+
+static u8 *jit_map(u32 size)
+{
+#ifdef _WIN32
+    return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    void *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return code == MAP_FAILED ? NULL : code;
+#endif
+}
+
+static bool jit_seal(u8 *code, u32 size)
+{
+#ifdef _WIN32
+    DWORD old;
+    return VirtualProtect(code, size, PAGE_EXECUTE_READ, &old) && FlushInstructionCache(GetCurrentProcess(), code, size);
+#else
+    return mprotect(code, size, PROT_READ | PROT_EXEC) == 0;
+#endif
+}
+
+bool jit_compile_block(block *b)
+{
+    jit_release_block(b);
+
+    struct block_jit *jit = calloc(1, sizeof(struct block_jit));
+    if (!jit)
+        return false;
+
+    jit->size = JIT_CODE_SIZE;
+    jit->code = jit_map(jit->size);
+    if (!jit->code)
+    {
+        free(jit);
+        return false;
+    }
+
+    emitter e = {.code = jit->code};
+
+    for (u16 pc = 0; pc < b->length; pc++)
+    {
+        const decoded_instruction *d = &b->decoded[pc];
+        if (!jit_supports(d))
+            continue;
+
+        const u32 start = e.at;
+        jit_emit_instruction(&e, b, d, pc);
+        assert(e.at - start <= JIT_MAX_TEMPLATE);
+        jit->entry[pc] = start + 1;
+    }
+
+    b->jit = jit;
+
+    if (!jit_seal(jit->code, jit->size))
+    {
+        jit_release_block(b);
+        return false;
+    }
+
+    return true;
+}
+
+#else
+
+bool jit_compile_block(block *b)
+{
+    (void)b;
+    return false;
+}
+
+#endif
@@ -0,0 +1,717 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/analysis.h"
+#include "../include/native.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <limits.h>
+#endif
+
+static const char *native_side_names[] = {"up", "right", "down", "left", "any"};
+
+/*
+    what the code is generated for: a lone program, where transfers look their neighbours up at run time, or the block
+    at x, y of a grid, where every neighbour and edge slot is resolved to an index now
+*/
+typedef struct
+{
+    FILE *out;
+    grid *g; // NULL for a lone program
+    u8 x, y;
+    u8 length;
+} native_target;
+
+static bool native_translatable(const u8 *bytecode, u8 length)
+{
+    for (u16 pc = 0; pc < length; pc++)
+    {
+        const instruction i = ((const instruction *)bytecode)[pc];
+        if ((i.operation == PUT || i.operation == POP) && (i.target == REF || i.target == ADJ))
+            return false;
+    }
+    return true;
+}
+
+// how the target itself refers to its neighbour and edge slot on side s, "NULL" if there is none
+static void native_neighbour_ref(const native_target *t, side s, char *out, u8 size)
+{
+    const block *neighbour = grid_step_block(t->g, t->x, t->y, s);
+    if (neighbour)
+        snprintf(out, size, "&g->blocks[%d]", (int)(neighbour - t->g->blocks));
+    else
+        snprintf(out, size, "NULL");
+}
+
+static void native_slot_ref(const native_target *t, side s, char *out, u8 size)
+{
+    const io_slot *slot = grid_step_edge(t->g, t->x, t->y, s);
+    if (slot)
+        snprintf(out, size, "&g->slots[%d]", (int)(slot - t->g->slots));
+    else
+        snprintf(out, size, "NULL");
+}
+
+// condition that is true when a transfer from side s delivered into v
+static void native_emit_read_condition(const native_target *t, side s)
+{
+    FILE *out = t->out;
+
+    if (!t->g)
+    {
+        fprintf(out, "api->read_from_io(g, b, x, y, %s, &v)", native_side_names[s]);
+        return;
+    }
+
+    // same order as block_read_from_io: neighbours first, then slots, missing neighbours do nothing
+    const side first = s == any ? up : s;
+    const side last = s == any ? left : s;
+    char ref[32];
+    bool chained = false;
+
+    for (side n = first; n <= last; n++)
+    {
+        if (!grid_step_block(t->g, t->x, t->y, n))
+            continue;
+        native_neighbour_ref(t, n, ref, sizeof(ref));
+        fprintf(out, "%sapi->read_from_block(b, %s, %s, &v)", chained ? " ||\n            " : "", ref,
+                native_side_names[n]);
+        chained = true;
+    }
+
+    for (side n = first; n <= last; n++)
+    {
+        native_slot_ref(t, n, ref, sizeof(ref));
+        fprintf(out, "%sapi->read_from_slot(b, %s, &v)", chained ? " ||\n            " : "", ref);
+        chained = true;
+    }
+}
+
+/*
+    v = operand of a local read, acc is what the code reads ACC through: the value itself when the analysis knows it,
+    so the C compiler can fold whatever depends on it
+*/
+static void native_emit_read(const native_target *t, const decoded_instruction *d, const pc_facts *f, u8 pc,
+                             const char *acc)
+{
+    FILE *out = t->out;
+
+    switch (d->target)
+    {
+    case STK:
+        if (f->stack_min)
+            fprintf(out, "        v = b->stack[(u8)b->stack_top];\n");
+        else
+            fprintf(out, "        v = b->stack_top < 0 ? 0 : b->stack[(u8)b->stack_top];\n");
+        break;
+    case ACC:
+        fprintf(out, "        v = %s;\n", acc);
+        break;
+    case RG0:
+    case RG1:
+    case RG2:
+    case RG3:
+        if (f->known & (1 << (FACT_RG0 + d->target - RG0)))
+            fprintf(out, "        v = %u;\n", f->value[FACT_RG0 + d->target - RG0]);
+        else
+            fprintf(out, "        v = b->registers[%d];\n", d->target - RG0);
+        break;
+    case ADJ:
+        fprintf(out, "        v = %u;\n", d->immediate);
+        break;
+    case REF:
+        if (f->overflow_live_out || d->operation == JOF) // JOF REF jumps on the flag this read sets
+        {
+            fprintf(out, "        b->last_caused_overflow = %s > %u;\n", acc, t->length);
+            fprintf(out, "        v = b->last_caused_overflow ? 0 : ((const u8 *)b->bytecode)[%s];\n", acc);
+        }
+        else
+            fprintf(out, "        v = %s > %u ? 0 : ((const u8 *)b->bytecode)[%s];\n", acc, t->length, acc);
+        break;
+    case SLN:
+        if (f->stack_min == f->stack_max)
+            fprintf(out, "        v = %u;\n", f->stack_min);
+        else
+            fprintf(out, "        v = b->stack_top >= 0 ? b->stack_top + 1 : 0;\n");
+        break;
+    case CUR:
+        fprintf(out, "        v = %u;\n", pc);
+        break;
+    default: // NIL
+        fprintf(out, "        v = 0;\n");
+        break;
+    }
+}
+
+static void native_emit_side_write(const native_target *t, const decoded_instruction *d, const char *value)
+{
+    FILE *out = t->out;
+
+    if (!t->g)
+    {
+        fprintf(out, "        api->write_to_side(g, b, x, y, %s, %s);\n", native_side_names[d->side], value);
+        return;
+    }
+
+    char neighbour[32];
+    char slot[32];
+
+    if (d->side != any)
+    {
+        native_neighbour_ref(t, d->side, neighbour, sizeof(neighbour));
+        native_slot_ref(t, d->side, slot, sizeof(slot));
+        fprintf(out, "        api->write_to_neighbour(b, %s, %s, %s, %s);\n", neighbour, slot,
+                native_side_names[d->side], value);
+        return;
+    }
+
+    // like block_write_to_any: the first writable edge slot gets the last transferred value
+    if (d->operation == POP)
+        fprintf(out, "        api->pop_stack(b);\n");
+
+    bool chained = false;
+    for (side n = up; n <= left; n++)
+    {
+        if (!grid_step_edge(t->g, t->x, t->y, n))
+            continue;
+        native_slot_ref(t, n, slot, sizeof(slot));
+        fprintf(out, "%sapi->write_to_slot(%s, b->transfer_value)", chained ? " ||\n            " : "        (void)(",
+                slot);
+        chained = true;
+    }
+    if (chained)
+        fprintf(out, ");\n");
+}
+
+static void native_emit_write(const native_target *t, const decoded_instruction *d, const pc_facts *f, const char *acc)
+{
+    FILE *out = t->out;
+    const char *value = d->operation == PUT ? acc : f->stack_min ? "b->stack[(u8)b->stack_top--]" : "api->pop_stack(b)";
+
+    if (d->flags & DECODED_IO)
+    {
+        native_emit_side_write(t, d, value);
+        return;
+    }
+
+    switch (d->target)
+    {
+    case STK:
+        fprintf(out, "        v = %s;\n", value);
+        if (f->stack_min > (d->operation == POP)) // still a value under the one POP took
+            fprintf(out, "        b->stack[(u8)b->stack_top] = v;\n");
+        else if (f->overflow_live_out)
+        {
+            fprintf(out, "        if (b->stack_top < 0)\n");
+            fprintf(out, "            b->last_caused_overflow = true;\n");
+            fprintf(out, "        else\n");
+            fprintf(out, "            b->stack[(u8)b->stack_top] = v;\n");
+        }
+        else
+        {
+            fprintf(out, "        if (b->stack_top >= 0)\n");
+            fprintf(out, "            b->stack[(u8)b->stack_top] = v;\n");
+        }
+        break;
+    case ACC:
+        fprintf(out, "        b->accumulator = %s;\n", value);
+        break;
+    case RG0:
+    case RG1:
+    case RG2:
+    case RG3:
+        fprintf(out, "        b->registers[%d] = %s;\n", d->target - RG0, value);
+        break;
+    default: // NIL, SLN and CUR ignore the value, ADJ and REF were refused
+        if (d->operation == POP)
+            fprintf(out, "        %s;\n", value);
+        break;
+    }
+}
+
+static void native_emit_extended(FILE *out, u8 ext_opcode, const char *acc)
+{
+    switch (ext_opcode)
+    {
+    case EXT_XOR:
+        fprintf(out, "        b->accumulator = %s ^ v;\n", acc);
+        break;
+    case EXT_AND:
+        fprintf(out, "        b->accumulator = %s & v;\n", acc);
+        break;
+    case EXT_OR:
+        fprintf(out, "        b->accumulator = %s | v;\n", acc);
+        break;
+    case EXT_NOT:
+        fprintf(out, "        b->accumulator = ~v;\n");
+        break;
+    case EXT_SHL:
+        fprintf(out, "        b->accumulator = v << (%s & 0x07);\n", acc);
+        break;
+    case EXT_SHR:
+        fprintf(out, "        b->accumulator = v >> (%s & 0x07);\n", acc);
+        break;
+    case EXT_ROL:
+        fprintf(out, "        s = %s & 0x07;\n", acc);
+        fprintf(out, "        b->accumulator = (v << s) | (v >> (8 - s));\n");
+        break;
+    case EXT_ROR:
+        fprintf(out, "        s = %s & 0x07;\n", acc);
+        fprintf(out, "        b->accumulator = (v >> s) | (v << (8 - s));\n");
+        break;
+    }
+}
+
+// overflow flag writes are left out where the analysis says no JOF can read them
+static void native_emit_operation(FILE *out, u8 operation, const pc_facts *f, const char *acc)
+{
+    const bool flag = f->overflow_live_out;
+
+    switch (operation)
+    {
+    case WAIT:
+        fprintf(out, "        b->waiting_ticks = v;\n");
+        break;
+    case ADD:
+        if (flag)
+            fprintf(out, "        b->last_caused_overflow = %s + v > 255;\n", acc);
+        fprintf(out, "        b->accumulator = %s + v;\n", acc);
+        break;
+    case SUB:
+        if (flag)
+            fprintf(out, "        b->last_caused_overflow = %s < v;\n", acc);
+        fprintf(out, "        b->accumulator = %s - v;\n", acc);
+        break;
+    case MLT:
+        if (flag)
+            fprintf(out, "        b->last_caused_overflow = %s * v > 255;\n", acc);
+        fprintf(out, "        b->accumulator = %s * v;\n", acc);
+        break;
+    case DIV:
+    case MOD:
+        if (flag)
+            fprintf(out, "        b->last_caused_overflow = v == 0;\n");
+        fprintf(out, "        if (v != 0)\n");
+        fprintf(out, "            b->accumulator = %s %s v;\n", acc, operation == DIV ? "/" : "%");
+        break;
+    case GET:
+        fprintf(out, "        b->accumulator = v;\n");
+        break;
+    case PUSH:
+        if (f->stack_max < 16)
+            fprintf(out, "        b->stack[(u8)++b->stack_top] = v;\n");
+        else if (flag)
+        {
+            fprintf(out, "        if (b->stack_top >= 15)\n");
+            fprintf(out, "            b->last_caused_overflow = true;\n");
+            fprintf(out, "        else\n");
+            fprintf(out, "            b->stack[(u8)++b->stack_top] = v;\n");
+        }
+        else
+        {
+            fprintf(out, "        if (b->stack_top < 15)\n");
+            fprintf(out, "            b->stack[(u8)++b->stack_top] = v;\n");
+        }
+        break;
+    case JMP:
+        fprintf(out, "        next = v;\n");
+        break;
+    case JEZ:
+        fprintf(out, "        if (%s == 0)\n", acc);
+        fprintf(out, "            next = v;\n");
+        break;
+    case JNZ:
+        fprintf(out, "        if (%s != 0)\n", acc);
+        fprintf(out, "            next = v;\n");
+        break;
+    case JOF:
+        fprintf(out, "        if (b->last_caused_overflow)\n");
+        fprintf(out, "        {\n");
+        fprintf(out, "            next = v;\n");
+        if (flag)
+            fprintf(out, "            b->last_caused_overflow = false;\n");
+        fprintf(out, "        }\n");
+        break;
+    }
+}
+
+static void native_emit_instruction(const native_target *t, const decoded_instruction *d, const pc_facts *f, u8 pc,
+                                    const char *exit)
+{
+    FILE *out = t->out;
+    char acc[16] = "b->accumulator";
+    if (f->known & (1 << FACT_ACC))
+        snprintf(acc, sizeof(acc), "%u", f->value[FACT_ACC]);
+
+    fprintf(out, "    case %u: // %s %s\n", pc, op_code_str(d->operation), target_str(d->target));
+
+    if (d->operation == HALT)
+    {
+        fprintf(out, "        b->state_halted = true;\n");
+        fprintf(out, "        %s;\n", exit);
+        return;
+    }
+
+    fprintf(out, "        next = %u;\n", (u8)(pc + d->length));
+
+    if (d->flags & DECODED_WRITING)
+    {
+        native_emit_write(t, d, f, acc);
+        fprintf(out, "        break;\n");
+        return;
+    }
+
+    if (d->flags & DECODED_IO)
+    {
+        fprintf(out, "        v = 0;\n");
+        fprintf(out, "        if (");
+        native_emit_read_condition(t, d->side);
+        fprintf(out, ")\n");
+        fprintf(out, "            b->transfer_value = v;\n");
+    }
+    else
+        native_emit_read(t, d, f, pc, acc);
+
+    if (d->operation == EXT)
+        native_emit_extended(out, d->ext_opcode, acc);
+    else
+        native_emit_operation(out, d->operation, f, acc);
+
+    fprintf(out, "        break;\n");
+}
+
+// one tick of the program in b, from the switch over the pc to moving the pc, exit leaves the tick early
+static void native_emit_program(const native_target *t, const u8 *bytecode, const char *exit)
+{
+    FILE *out = t->out;
+
+    program_facts facts;
+    analyze_program(bytecode, t->length, &facts);
+
+    fprintf(out, "    switch (b->current_instruction)\n");
+    fprintf(out, "    {\n");
+
+    // the pc can land on any byte, operands included, so every address it can reach gets a case
+    for (u16 pc = 0; pc < t->length; pc++)
+    {
+        const instruction i = ((const instruction *)bytecode)[pc];
+        if (!facts.pc[pc].reachable || pc + instruction_operand_bytes(i) >= t->length)
+            continue; // operands past the end depend on what follows the program in memory
+
+        const decoded_instruction d = decode_instruction(bytecode, pc);
+        native_emit_instruction(t, &d, &facts.pc[pc], pc, exit);
+    }
+
+    fprintf(out, "    default:\n");
+    if (t->g)
+        fprintf(out, "        api->interpret(g, b, %u, %u);\n", t->x, t->y);
+    else
+        fprintf(out, "        api->interpret(g, b, x, y);\n");
+    fprintf(out, "        %s;\n", exit);
+    fprintf(out, "    }\n\n");
+    fprintf(out, "    if (!b->io_blocked)\n");
+    fprintf(out, "        b->current_instruction = next >= %u ? %u : next;\n", t->length, t->length - 1);
+}
+
+bool native_emit_c(FILE *out, const u8 *bytecode, u8 length, const char *function_name)
+{
+    if (!length || !native_translatable(bytecode, length))
+        return false;
+
+    const native_target t = {.out = out, .length = length};
+
+    fprintf(out, "// generated by bl2c, one tick of a %u byte program\n\n", length);
+    fprintf(out, "#include \"native.h\"\n\n");
+    fprintf(out, "void %s(grid *g, block *b, u8 x, u8 y, const native_api *api)\n", function_name);
+    fprintf(out, "{\n");
+    fprintf(out, "    u8 v, s, next;\n");
+    fprintf(out, "    (void)s;\n\n");
+    native_emit_program(&t, bytecode, "return");
+    fprintf(out, "}\n");
+
+    return !ferror(out);
+}
+
+bool native_emit_grid_c(FILE *out, grid *g, const char *function_name)
+{
+    fprintf(out, "// generated by blocklang, one tick of a %ux%u grid\n\n", g->width, g->height);
+    fprintf(out, "#include \"native.h\"\n\n");
+    fprintf(out, "void %s(grid *g, const native_api *api)\n", function_name);
+    fprintf(out, "{\n");
+    fprintf(out, "    block *b;\n");
+    fprintf(out, "    u8 v, s, next;\n");
+    fprintf(out, "    (void)v, (void)s, (void)next, (void)api;\n");
+
+    // same order and the same per-block steps as block_exec_instruction_mono
+    for (u8 y = 0; y < g->height; y++)
+        for (u8 x = 0; x < g->width; x++)
+        {
+            const u16 n = y * g->width + x;
+            const block *b = &g->blocks[n];
+
+            if (!b->bytecode)
+                continue;
+
+            fprintf(out, "\n    // %u, %u\n", x, y);
+            fprintf(out, "    b = &g->blocks[%u];\n", n);
+
+            if (!b->length || !native_translatable((const u8 *)b->bytecode, b->length))
+            {
+                fprintf(out, "    api->exec_block(g, b, %u, %u);\n", x, y);
+                continue;
+            }
+
+            char exit[32];
+            snprintf(exit, sizeof(exit), "goto done_%u", n);
+
+            fprintf(out, "    if (b->state_halted)\n");
+            fprintf(out, "        %s;\n", exit);
+            fprintf(out, "    g->any_ticked = true;\n");
+            fprintf(out, "    if (b->waiting_ticks)\n");
+            fprintf(out, "    {\n");
+            fprintf(out, "        b->waiting_ticks--;\n");
+            fprintf(out, "        %s;\n", exit);
+            fprintf(out, "    }\n");
+            fprintf(out, "    if (b->fused_ticks)\n");
+            fprintf(out, "    {\n");
+            fprintf(out, "        if (--b->fused_ticks == 0)\n");
+            fprintf(out, "            b->current_instruction = b->fused_resume;\n");
+            fprintf(out, "        %s;\n", exit);
+            fprintf(out, "    }\n");
+            fprintf(out, "    if (b->current_instruction >= %u)\n", b->length);
+            fprintf(out, "        b->current_instruction = 0;\n\n");
+
+            const native_target t = {.out = out, .g = g, .x = x, .y = y, .length = b->length};
+            native_emit_program(&t, (const u8 *)b->bytecode, exit);
+            fprintf(out, "done_%u:;\n", n);
+        }
+
+    fprintf(out, "}\n");
+
+    return !ferror(out);
+}
+
+const char *native_library_extension(void)
+{
+#ifdef _WIN32
+    return ".dll";
+#else
+    return ".so";
+#endif
+}
+
+bool native_compile(const char *c_path, const char *lib_path, const char *include_dir)
+{
+    const char *cc = getenv("CC");
+    if (!cc || !*cc)
+#ifdef _WIN32
+        cc = "gcc";
+#else
+        cc = "cc";
+#endif
+
+    char command[1024];
+    const int len = snprintf(command, sizeof(command), "%s -O2 -shared -fPIC -I\"%s\" -o \"%s\" \"%s\"", cc,
+                             include_dir, lib_path, c_path);
+    if (len < 0 || len >= (int)sizeof(command))
+        return false;
+
+    return system(command) == 0;
+}
+
+const char *native_include_dir(void)
+{
+    const char *include_dir = getenv("BLOCKLANG_INCLUDE");
+    return include_dir && *include_dir ? include_dir : "include";
+}
+
+static void native_close(void *library)
+{
+#ifdef _WIN32
+    FreeLibrary(library);
+#else
+    dlclose(library);
+#endif
+}
+
+// opens lib_path and looks up symbol in it, NULL if either fails
+static void *native_open(const char *lib_path, const char *symbol, void **out_address)
+{
+#ifdef _WIN32
+    HMODULE library = LoadLibraryA(lib_path);
+    if (!library)
+        return NULL;
+
+    union
+    {
+        FARPROC proc;
+        void *address;
+    } found = {.proc = GetProcAddress(library, symbol)};
+    *out_address = found.address;
+#else
+    void *library = dlopen(lib_path, RTLD_NOW | RTLD_LOCAL);
+    if (!library)
+        return NULL;
+
+    *out_address = dlsym(library, symbol);
+#endif
+
+    if (!*out_address)
+    {
+        native_close(library);
+        return NULL;
+    }
+
+    return library;
+}
+
+// writes path_prefix.c with emit, builds it and puts the absolute path of the library into lib_path
+static bool native_build(const char *path_prefix, const char *include_dir, bool (*emit)(FILE *out, void *what),
+                         void *what, char *lib_path, u16 lib_path_size)
+{
+    char c_path[512];
+    char relative_path[512];
+    snprintf(c_path, sizeof(c_path), "%s.c", path_prefix);
+    snprintf(relative_path, sizeof(relative_path), "%s%s", path_prefix, native_library_extension());
+
+    FILE *f = fopen(c_path, "w");
+    if (!f)
+        return false;
+
+    const bool emitted = emit(f, what);
+    fclose(f);
+
+    if (!emitted)
+    {
+        remove(c_path);
+        return false;
+    }
+
+    if (!native_compile(c_path, relative_path, include_dir))
+        return false;
+
+    // a relative path would make dlopen search the library path instead
+#ifdef _WIN32
+    const DWORD length = GetFullPathNameA(relative_path, lib_path_size, lib_path, NULL);
+    return length != 0 && length < lib_path_size;
+#else
+    char full_path[PATH_MAX];
+    if (!realpath(relative_path, full_path) || strlen(full_path) >= lib_path_size)
+        return false;
+    strcpy(lib_path, full_path);
+    return true;
+#endif
+}
+
+void native_release_block(block *b)
+{
+    if (!b->native)
+        return;
+
+    native_close(b->native->library);
+    free(b->native);
+    b->native = NULL;
+}
+
+bool native_load(grid *g, u8 x, u8 y, const char *lib_path, const char *function_name)
+{
+    block *b = &g->blocks[y * g->width + x];
+
+    if (!b->bytecode || b->self_modifying)
+        return false;
+
+    native_release_block(b);
+
+    union
+    {
+        void *address;
+        native_tick_fn fn;
+    } tick;
+
+    void *library = native_open(lib_path, function_name, &tick.address);
+    if (!library)
+        return false;
+
+    if (!(b->native = malloc(sizeof(struct block_native))))
+    {
+        native_close(library);
+        return false;
+    }
+
+    b->native->tick = tick.fn;
+    b->native->library = library;
+    return true;
+}
+
+static bool native_emit_block(FILE *out, void *what)
+{
+    const block *b = what;
+    return native_emit_c(out, (const u8 *)b->bytecode, b->length, NATIVE_TICK_SYMBOL);
+}
+
+bool native_build_and_load(grid *g, u8 x, u8 y, const char *path_prefix, const char *include_dir)
+{
+    block *b = &g->blocks[y * g->width + x];
+    if (!b->bytecode)
+        return false;
+
+    char lib_path[1024];
+    if (!native_build(path_prefix, include_dir, native_emit_block, b, lib_path, sizeof(lib_path)))
+        return false;
+
+    return native_load(g, x, y, lib_path, NATIVE_TICK_SYMBOL);
+}
+
+void native_release_grid(grid *g)
+{
+    if (!g->native)
+        return;
+
+    native_close(g->native->library);
+    free(g->native);
+    g->native = NULL;
+}
+
+bool native_load_grid(grid *g, const char *lib_path, const char *function_name)
+{
+    native_release_grid(g);
+
+    union
+    {
+        void *address;
+        native_grid_tick_fn fn;
+    } tick;
+
+    void *library = native_open(lib_path, function_name, &tick.address);
+    if (!library)
+        return false;
+
+    if (!(g->native = malloc(sizeof(struct grid_native))))
+    {
+        native_close(library);
+        return false;
+    }
+
+    g->native->tick = tick.fn;
+    g->native->library = library;
+    g->live_dirty = true; // the compiled tick runs pruned blocks too
+    return true;
+}
+
+static bool native_emit_whole_grid(FILE *out, void *what)
+{
+    return native_emit_grid_c(out, what, NATIVE_GRID_TICK_SYMBOL);
+}
+
+bool native_build_and_load_grid(grid *g, const char *path_prefix, const char *include_dir)
+{
+    char lib_path[1024];
+    if (!native_build(path_prefix, include_dir, native_emit_whole_grid, g, lib_path, sizeof(lib_path)))
+        return false;
+
+    return native_load_grid(g, lib_path, NATIVE_GRID_TICK_SYMBOL);
+}
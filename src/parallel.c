@@ -0,0 +1,109 @@
+#include <stdlib.h>
+
+#include "../include/parallel.h"
+
+// live[from[n]] is the first live block at or past row first_row[n]
+static void pool_split_live(struct grid_pool *p)
+{
+    const grid *g = p->g;
+    u16 i = 0;
+
+    for (u16 n = 0; n <= p->bands; n++)
+    {
+        while (i < g->live_count && g->live[i].y < p->first_row[n])
+            i++;
+        p->from[n] = i;
+    }
+}
+
+static void pool_band(struct grid_pool *p, u16 n)
+{
+    grid_post_intents(p->g, p->from[n], p->from[n + 1]);
+    pthread_barrier_wait(&p->barrier);
+    p->changed[n] = grid_commit_intents(p->g, p->from[n], p->from[n + 1]);
+    pthread_barrier_wait(&p->barrier);
+}
+
+static void *pool_work(void *arg)
+{
+    const pool_worker *w = arg;
+    struct grid_pool *p = w->pool;
+
+    pthread_mutex_lock(&p->starting);
+    pthread_mutex_unlock(&p->starting);
+    if (w->band >= p->bands) // a thread after it could not be started
+        return NULL;
+
+    while (true)
+    {
+        pthread_barrier_wait(&p->barrier); // a tick starts, or the run is over
+        if (p->stop)
+            return NULL;
+        pool_band(p, w->band);
+    }
+}
+
+void parallel_tick(grid *g)
+{
+    struct grid_pool *p = g->pool;
+
+    pool_split_live(p);
+    pthread_barrier_wait(&p->barrier);
+    pool_band(p, 0);
+
+    bool changed = false;
+    for (u16 n = 0; n < p->bands; n++)
+        changed |= p->changed[n];
+
+    grid_finish_two_phase(g, changed);
+}
+
+// the calling thread takes the first band, threads that cannot be started leave fewer bands
+grid_status run_grid_parallel(grid *g, u32 max_ticks, int threads)
+{
+    g->two_phase = true;
+
+    u16 wanted = threads < 1 ? 1 : threads;
+    if (wanted > g->height)
+        wanted = g->height;
+    if (wanted > PARALLEL_MAX_THREADS)
+        wanted = PARALLEL_MAX_THREADS;
+
+    struct grid_pool *p = wanted > 1 ? malloc(sizeof(struct grid_pool)) : NULL;
+    if (!p)
+        return run_grid(g, max_ticks);
+
+    p->g = g;
+    p->stop = false;
+    p->bands = wanted;
+    pthread_mutex_init(&p->starting, NULL);
+    pthread_mutex_lock(&p->starting);
+
+    u16 started = 1;
+    for (; started < wanted; started++)
+    {
+        p->workers[started] = (pool_worker){.pool = p, .band = started};
+        if (pthread_create(&p->threads[started], NULL, pool_work, &p->workers[started]))
+            break;
+    }
+
+    p->bands = started;
+    for (u16 n = 0; n <= p->bands; n++)
+        p->first_row[n] = n * g->height / p->bands;
+    pthread_barrier_init(&p->barrier, NULL, p->bands);
+    pthread_mutex_unlock(&p->starting);
+
+    g->pool = p;
+    const grid_status status = run_grid(g, max_ticks);
+    g->pool = NULL;
+
+    p->stop = true;
+    pthread_barrier_wait(&p->barrier);
+    for (u16 n = 1; n < started; n++)
+        pthread_join(p->threads[n], NULL);
+
+    pthread_barrier_destroy(&p->barrier);
+    pthread_mutex_destroy(&p->starting);
+    free(p);
+    return status;
+}
@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include "../include/verify.h"
+
+#define DEPTH_UNKNOWN -1
+
+// marks every address the linear decoding starts an instruction at, leaving out a last one that runs past the end
+static void verify_boundaries(const u8 *bytecode, u8 length, bool *boundary)
+{
+    for (u16 pc = 0; pc < length;)
+    {
+        const instruction i = ((const instruction *)bytecode)[pc];
+        if (pc + instruction_operand_bytes(i) >= length)
+            return;
+
+        boundary[pc] = true;
+        pc += 1 + instruction_operand_bytes(i);
+    }
+}
+
+// stack depth an instruction needs before it runs and how it changes it, false if it touches the stack through a side
+static bool verify_stack_effect(const decoded_instruction *d, i8 *needs, i8 *change)
+{
+    *needs = 0;
+    *change = 0;
+
+    if (d->operation == PUSH || d->operation == POP)
+    {
+        if (d->flags & DECODED_IO)
+            return false;
+
+        *needs = d->operation == POP ? 1 : 0;
+        *change = d->operation == POP ? -1 : 1;
+
+        if (d->operation == POP && d->target == STK) // writes to the new top after popping
+            *needs = 2;
+        else if (d->operation == PUSH && d->target == STK)
+            *needs = 1;
+        return true;
+    }
+
+    if (d->operation != HALT && d->target == STK)
+        *needs = 1;
+
+    return true;
+}
+
+/*
+    where the pc can go after d, at most two places. false for jumps to computed addresses, which could be anywhere
+
+    a blocked transfer stays at pc, which is already being visited
+*/
+static bool verify_successors(const decoded_instruction *d, u8 pc, u16 *next, u8 *count)
+{
+    const u16 fallthrough = pc + d->length;
+    *count = 0;
+
+    if (d->operation == HALT)
+        return true;
+
+    if (d->operation != JMP)
+        next[(*count)++] = fallthrough;
+
+    if (d->operation < JMP || d->operation > JOF)
+        return true;
+
+    switch (d->target)
+    {
+    case ADJ:
+        next[(*count)++] = d->immediate;
+        return true;
+    case NIL:
+        next[(*count)++] = 0;
+        return true;
+    case CUR:
+        next[(*count)++] = pc;
+        return true;
+    }
+
+    return false;
+}
+
+bool verify_program(const u8 *bytecode, u8 length)
+{
+    if (!length)
+        return false;
+
+    bool boundary[256] = {0};
+    verify_boundaries(bytecode, length, boundary);
+
+    i8 depth[256];
+    memset(depth, DEPTH_UNKNOWN, sizeof(depth));
+
+    u8 worklist[256];
+    u16 pending = 0;
+
+    if (!boundary[0])
+        return false;
+
+    depth[0] = 0;
+    worklist[pending++] = 0;
+
+    while (pending)
+    {
+        const u8 pc = worklist[--pending];
+        const decoded_instruction d = decode_instruction(bytecode, pc);
+
+        if ((d.flags & DECODED_WRITING) && (d.target == REF || d.target == ADJ))
+            return false;
+
+        if (d.operation == EXT && d.ext_opcode >= EXT_GUARD_LAST)
+            return false;
+
+        i8 needs, change;
+        if (!verify_stack_effect(&d, &needs, &change))
+            return false;
+
+        if (depth[pc] < needs || depth[pc] + change > 16)
+            return false;
+
+        u16 next[2];
+        u8 count;
+        if (!verify_successors(&d, pc, next, &count))
+            return false;
+
+        for (u8 n = 0; n < count; n++)
+        {
+            if (next[n] >= length || !boundary[next[n]])
+                return false;
+
+            const i8 next_depth = depth[pc] + change;
+            if (depth[next[n]] == DEPTH_UNKNOWN)
+            {
+                depth[next[n]] = next_depth;
+                worklist[pending++] = next[n];
+            }
+            else if (depth[next[n]] != next_depth)
+                return false;
+        }
+    }
+
+    return true;
+}
@@ -1,42 +1,44 @@
 #include "../include/definitions.h"
+#include "../include/history.h"
+#include "../include/jit.h"
+#include "../include/native.h"
+#include "../include/parallel.h"
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
+#ifdef __GNUC__
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#define UNREACHABLE() __builtin_unreachable()
+#else
+#define ALWAYS_INLINE inline
+#define UNREACHABLE()
+#endif
+
+// sides past left (any, invalid) lead nowhere
 block *grid_step_block(grid *g, const u8 x, const u8 y, const u8 side)
 {
-    u8 offset_x = x;
-    u8 offset_y = y;
-
-    offset_x += side == right && x != g->width - 1 ? 1 : 0;
-    offset_x += side == left && x != 0 ? -1 : 0;
-    offset_y += side == down && y != g->height - 1 ? 1 : 0;
-    offset_y += side == up && y != 0 ? -1 : 0;
-
-    if (offset_x == x && offset_y == y)
-        return NULL;
-
-    return &g->blocks[offset_y * g->width + offset_x];
+    return side <= left ? g->links[y * g->width + x].neighbour[side] : NULL;
 }
 
 io_slot *grid_step_edge(grid *g, const u8 x, const u8 y, const u8 side)
 {
-    if ((side == up && y == 0) ||               //
-        (side == down && y == g->height - 1) || //
-        (side == left && x == 0) ||             //
-        (side == right && x == g->width - 1)    //
-    )
-        return &g->slots[io_slot_offset(g, side, side == up || side == down ? x : y)];
-    return NULL;
+    return side <= left ? g->links[y * g->width + x].slot[side] : NULL;
 }
 
-bool can_read(const io_slot *slot)
+// both remember finding the slot at its end, a rerun cannot go back past that if the length changes
+bool can_read(io_slot *slot)
 {
+    if (slot->read_only && slot->cur >= slot->len)
+        slot->ended = true;
     return slot->read_only && slot->cur < slot->len;
 }
 
-bool can_write(const io_slot *slot)
+bool can_write(io_slot *slot)
 {
+    if (!slot->read_only && slot->cur >= slot->len)
+        slot->ended = true;
     return !slot->read_only && slot->cur < slot->len;
 }
 
@@ -178,6 +180,194 @@ bool is_writing(instruction i)
     return false;
 }
 
+u8 instruction_operand_bytes(instruction i)
+{
+    if (i.operation == HALT) // never looks past its own byte
+        return 0;
+    return (i.operation == EXT) + (i.target == ADJ);
+}
+
+decoded_instruction decode_instruction(const u8 *bytes, u8 pc)
+{
+    const instruction i = ((const instruction *)bytes)[pc];
+    decoded_instruction d = {
+        .operation = i.operation,
+        .target = i.target,
+        .length = 1,
+        .side = block_get_transfer_side(i),
+        .flags = DECODED_VALID,
+    };
+
+    if (is_target_used(i) && d.side != invalid)
+        d.flags |= DECODED_IO;
+    if (is_writing(i))
+        d.flags |= DECODED_WRITING;
+
+    if (i.operation == HALT)
+        return d;
+
+    if (i.operation == EXT)
+        d.ext_opcode = bytes[pc + d.length++];
+    if (i.target == ADJ)
+        d.immediate = bytes[pc + d.length++];
+
+    return d;
+}
+
+/*
+    superinstructions: sequences that run in the tick of their first instruction and then owe the block one tick per
+    extra instruction, see block_exec_fused
+
+    everything after the first step must be local, so the block looks the same to its neighbours whichever of the
+    fused instructions it is sitting at, and only the last step may jump. picked from the sequence counts gathered
+    with BLOCKLANG_SEQUENCE_STATS over programs/ and the codegen output
+*/
+
+#define TARGET_BIT(t) (1u << (t))
+#define TARGETS_ANY 0xFFFFu
+#define TARGETS_SIDES (TARGET_BIT(UP) | TARGET_BIT(RIGHT) | TARGET_BIT(DOWN) | TARGET_BIT(LEFT) | TARGET_BIT(ANY))
+#define TARGETS_LOCAL (TARGETS_ANY & ~TARGETS_SIDES)
+#define TARGETS_REGS (TARGET_BIT(RG0) | TARGET_BIT(RG1) | TARGET_BIT(RG2) | TARGET_BIT(RG3))
+
+#define FUSED_MAX 3
+#define FUSED_MAX_BYTES 6 // none of the fused instructions are extended, so 2 bytes each at most
+
+typedef struct
+{
+    u8 operation;
+    u16 targets;
+} fusion_step;
+
+typedef struct
+{
+    u8 count;
+    fusion_step steps[FUSED_MAX];
+} fusion_pattern;
+
+static const fusion_pattern fusion_patterns[] = {
+    {3, {{POP, TARGET_BIT(ACC)}, {ADD, TARGET_BIT(ADJ)}, {JMP, TARGET_BIT(ACC)}}}, // __f_ret_void epilogue
+    {3, {{PUT, TARGET_BIT(RG0)}, {GET, TARGETS_LOCAL}, {ADD, TARGET_BIT(RG0)}}},   // acc = x + acc
+    {2, {{GET, TARGETS_ANY}, {PUT, TARGETS_REGS}}},                                 // load into a register
+    {2, {{PUT, TARGETS_REGS}, {GET, TARGETS_LOCAL}}},                               // spill, then load
+    {2, {{GET, TARGETS_SIDES}, {JOF, TARGET_BIT(ADJ)}}},                            // read or bail out
+};
+
+static u8 block_match_fusion(const block *b, u8 pc)
+{
+    for (u8 p = 0; p < sizeof(fusion_patterns) / sizeof(fusion_patterns[0]); p++)
+    {
+        const fusion_pattern *pattern = &fusion_patterns[p];
+        u16 at = pc;
+        u8 step = 0;
+
+        for (; step < pattern->count; step++)
+        {
+            if (at >= b->length || at + instruction_operand_bytes(b->bytecode[at]) >= b->length)
+                break;
+
+            const decoded_instruction d = decode_instruction((const u8 *)b->bytecode, at);
+            if (d.operation != pattern->steps[step].operation ||
+                !(pattern->steps[step].targets & TARGET_BIT(d.target)))
+                break;
+
+            at += d.length;
+        }
+
+        if (step == pattern->count)
+            return pattern->count;
+    }
+
+    return 0;
+}
+
+static void block_decode_at(block *b, u8 pc)
+{
+    b->decoded[pc] = decode_instruction((const u8 *)b->bytecode, pc);
+    b->decoded[pc].fused = block_match_fusion(b, pc);
+}
+
+static inline const decoded_instruction *block_fetch(block *b, u8 pc)
+{
+    if (!(b->decoded[pc].flags & DECODED_VALID))
+        block_decode_at(b, pc);
+    return &b->decoded[pc];
+}
+
+// instruction a neighbour is sitting at, without decoding operands that it might never execute
+static inline instruction block_peek(const block *b)
+{
+    const decoded_instruction *d = &b->decoded[b->current_instruction];
+    if (d->flags & DECODED_VALID)
+        return (instruction){.operation = d->operation, .target = d->target};
+    return b->bytecode[b->current_instruction];
+}
+
+static inline bool block_mask_test(const u64 *mask, u8 pc)
+{
+    return mask[pc >> 6] >> (pc & 63) & 1;
+}
+
+static inline void block_mask_set(u64 *mask, u8 pc, bool set)
+{
+    if (set)
+        mask[pc >> 6] |= 1ull << (pc & 63);
+    else
+        mask[pc >> 6] &= ~(1ull << (pc & 63));
+}
+
+// block.names_side and block.writing for the byte at pc
+static void block_mark_transfer(block *b, u8 pc)
+{
+    const instruction i = b->bytecode[pc];
+
+    for (side s = up; s <= left; s++)
+        block_mask_set(b->names_side[s], pc, i.target == to_target(s));
+    block_mask_set(b->writing, pc, is_writing(i));
+}
+
+void block_decode_program(block *b)
+{
+    memset(b->decoded, 0, sizeof(b->decoded));
+    memset(b->names_side, 0, sizeof(b->names_side));
+    memset(b->writing, 0, sizeof(b->writing));
+    b->self_modifying = false;
+
+    // instructions with operands past the end are left to be decoded when (and if) they are reached
+    for (u16 pc = 0; pc < b->length; pc++)
+    {
+        const instruction i = b->bytecode[pc];
+        if (pc + instruction_operand_bytes(i) < b->length)
+            block_decode_at(b, pc);
+        block_mark_transfer(b, pc);
+
+        // data bytes count too, the program may jump into them
+        if (is_writing(i) && (i.target == REF || i.target == ADJ))
+            b->self_modifying = true;
+    }
+}
+
+// bytecode at addr changed, drop every decoded instruction that covers it in every block running the same program and
+// mark what the new byte transfers through
+static void grid_invalidate_decoded(grid *g, const instruction *bytecode, u16 addr)
+{
+    for (u16 n = 0; n < g->width * g->height; n++)
+    {
+        block *b = &g->blocks[n];
+        if (b->bytecode != bytecode)
+            continue;
+
+        for (u16 pc = addr >= FUSED_MAX_BYTES - 1 ? addr - (FUSED_MAX_BYTES - 1) : 0; pc <= addr && pc < 256; pc++)
+        {
+            b->decoded[pc].flags &= ~DECODED_VALID;
+            if (b->jit)
+                jit_invalidate(b, pc);
+        }
+
+        if (addr < b->length)
+            block_mark_transfer(b, addr);
+    }
+}
+
 u8 block_pop_stack(block *b)
 {
     if (b->stack_top < 0)
@@ -199,26 +389,32 @@ void block_push_stack(block *b, u8 value)
     b->stack[(u8)b->stack_top++] = value;
 }
 
+bool block_write_to_slot(io_slot *slot, u8 value)
+{
+    if (!slot || !can_write(slot))
+        return false;
+
+    write_byte(slot, value);
+    return true;
+}
+
 void block_write_to_any(grid *g, block *b, u8 x, u8 y, u8 value)
 {
-    io_slot *slot = NULL;
     for (u8 s = up; s <= left; s++)
-    {
-        slot = grid_step_edge(g, x, y, s);
-        if (slot && can_write(slot))
-        {
-            write_byte(slot, b->transfer_value);
+        if (block_write_to_slot(grid_step_edge(g, x, y, s), b->transfer_value))
             return;
-        }
-    }
 }
 
-void block_write_to_target(grid *g, block *b, instruction i, u8 value, u8 *advance_to)
+/*
+    target is a separate argument so specialized handlers can pass a constant and lose the switch. checked is false
+    only for verified programs, see verify.h, and drops the checks the verifier proved redundant
+*/
+static ALWAYS_INLINE void block_write_local(grid *g, block *b, u8 target, u8 value, const bool checked)
 {
-    switch (i.target)
+    switch (target)
     {
     case STK:
-        if (b->stack_top < 0)
+        if (checked && b->stack_top < 0)
             b->last_caused_overflow = true;
         else
             b->stack[(u8)b->stack_top] = value;
@@ -230,18 +426,21 @@ void block_write_to_target(grid *g, block *b, instruction i, u8 value, u8 *advan
     case RG1:
     case RG2:
     case RG3:
-        b->registers[i.target - RG0] = value;
+        b->registers[target - RG0] = value;
         break;
     case ADJ:
         ((u8 *)(b->bytecode))[b->current_instruction + 1] = value;
-        (*advance_to)++;
+        grid_invalidate_decoded(g, b->bytecode, b->current_instruction + 1);
         break;
     case REF:;
         const u8 addr = value;
         const bool toofar = addr > b->length;
         b->last_caused_overflow = toofar;
         if (!toofar)
+        {
             ((u8 *)(b->bytecode))[addr] = b->registers[3];
+            grid_invalidate_decoded(g, b->bytecode, addr);
+        }
         break;
     case NIL:
     case SLN:
@@ -251,9 +450,13 @@ void block_write_to_target(grid *g, block *b, instruction i, u8 value, u8 *advan
     }
 }
 
-static bool block_write_to_block_direct(grid *g, block *src, u8 x, u8 y, side side, u8 value)
+void block_write_to_target(grid *g, block *b, const decoded_instruction *d, u8 value)
+{
+    block_write_local(g, b, d->target, value, true);
+}
+
+static bool block_write_to_block_direct(block *src, block *dst, side side, u8 value)
 {
-    block *dst = grid_step_block(g, x, y, side);
     if (!dst)
         return false;
 
@@ -266,16 +469,10 @@ static bool block_write_to_block_direct(grid *g, block *src, u8 x, u8 y, side si
     if (dst->current_instruction >= dst->length)
         return false;
 
-    instruction dst_i = dst->bytecode[dst->current_instruction];
-
-    target_t needed_side = to_target(get_opposite_side(side));
-    if (dst_i.target != needed_side) // block io until dest block has the side opposite to ours in its target bits
-    {
-        src->io_blocked = true;
-        return false;
-    }
-
-    if (is_writing(dst_i)) // if its writing to us, stay blocked. Causes deadlocks!
+    // block io until dest block has the side opposite to ours in its target bits. if its writing to us, stay blocked.
+    // Causes deadlocks!
+    const u8 pc = dst->current_instruction;
+    if (!block_mask_test(dst->names_side[get_opposite_side(side)], pc) || block_mask_test(dst->writing, pc))
     {
         src->io_blocked = true;
         return false;
@@ -290,32 +487,33 @@ static bool block_write_to_block_direct(grid *g, block *src, u8 x, u8 y, side si
     return true;
 }
 
-void block_write_to_side(grid *g, block *b, u8 x, u8 y, side side, u8 value)
+// write to one side with the neighbour and the edge slot on it already looked up, either can be NULL
+void block_write_to_neighbour(block *b, block *dst, io_slot *slot, side side, u8 value)
 {
-    if (side == any)
-    {
-        block_write_to_any(g, b, x, y, value);
+    if (block_write_to_slot(slot, value))
+        return;
+
+    if (block_write_to_block_direct(b, dst, side, value))
         return;
-    }
 
-    io_slot *slot = grid_step_edge(g, x, y, side);
+    if (!slot && !b->io_blocked)
+        b->last_caused_overflow = true;
+}
 
-    if (slot && can_write(slot))
+void block_write_to_side(grid *g, block *b, u8 x, u8 y, side side, u8 value)
+{
+    if (side == any)
     {
-        write_byte(slot, value);
+        block_write_to_any(g, b, x, y, value);
         return;
     }
 
-    if (block_write_to_block_direct(g, b, x, y, side, value))
-        return;
-
-    if (!slot && !b->io_blocked)
-        b->last_caused_overflow = true;
+    block_write_to_neighbour(b, grid_step_block(g, x, y, side), grid_step_edge(g, x, y, side), side, value);
 }
 
-u8 block_get_instruction_write_operand(block *b, instruction i)
+u8 block_get_instruction_write_operand(block *b, u8 operation)
 {
-    switch (i.operation)
+    switch (operation)
     {
     case PUT:
         return b->accumulator;
@@ -326,12 +524,12 @@ u8 block_get_instruction_write_operand(block *b, instruction i)
     return 0;
 }
 
-u8 block_get_operand_value(block *b, instruction i, u8 *advance_to)
+static ALWAYS_INLINE u8 block_read_local(block *b, const decoded_instruction *d, u8 target, const bool checked)
 {
-    switch (i.target)
+    switch (target)
     {
     case STK:
-        if (b->stack_top < 0)
+        if (checked && b->stack_top < 0)
             return 0;
         return b->stack[(u8)b->stack_top];
     case ACC:
@@ -340,11 +538,9 @@ u8 block_get_operand_value(block *b, instruction i, u8 *advance_to)
     case RG1:
     case RG2:
     case RG3:
-        return b->registers[i.target - RG0];
+        return b->registers[target - RG0];
     case ADJ:
-        (*advance_to)++;
-        // since EXT reads from the next byte, ADJ is actualy next after ext opcode
-        return ((u8 *)(b->bytecode))[b->current_instruction + (i.operation == EXT ? 2 : 1)];
+        return d->immediate;
     case REF:;
         const u8 addr = b->accumulator;
         const bool toofar = addr > b->length;
@@ -361,7 +557,13 @@ u8 block_get_operand_value(block *b, instruction i, u8 *advance_to)
     }
 }
 
-void block_execute_operation(block *b, u8 operation, u8 operand_value, u8 *advance_to)
+u8 block_get_operand_value(block *b, const decoded_instruction *d)
+{
+    return block_read_local(b, d, d->target, true);
+}
+
+static ALWAYS_INLINE void block_apply_operation(block *b, u8 operation, u8 operand_value, u8 *advance_to,
+                                                const bool checked)
 {
     switch (operation)
     {
@@ -394,7 +596,7 @@ void block_execute_operation(block *b, u8 operation, u8 operand_value, u8 *advan
         b->accumulator = operand_value;
         break;
     case PUSH:
-        if (b->stack_top >= 15)
+        if (checked && b->stack_top >= 15)
         {
             b->last_caused_overflow = true;
             break;
@@ -425,7 +627,12 @@ void block_execute_operation(block *b, u8 operation, u8 operand_value, u8 *advan
     }
 }
 
-void block_exec_extended_op(block *b, u8 ext_opcode, u8 target_value, u8 *advance_to)
+void block_execute_operation(block *b, u8 operation, u8 operand_value, u8 *advance_to)
+{
+    block_apply_operation(b, operation, operand_value, advance_to, true);
+}
+
+static ALWAYS_INLINE void block_apply_extended_op(block *b, u8 ext_opcode, u8 target_value, const bool checked)
 {
     u8 acc_value = b->accumulator;
     u8 shift;
@@ -461,13 +668,20 @@ void block_exec_extended_op(block *b, u8 ext_opcode, u8 target_value, u8 *advanc
         b->accumulator = (target_value >> shift) | (target_value << (8 - shift));
         break;
     default:
+        if (!checked)
+            UNREACHABLE();
         break;
     }
 }
 
-bool block_try_read_from_neighbor(grid *g, block *b, u8 x, u8 y, side s, u8 *out_value)
+void block_exec_extended_op(block *b, u8 ext_opcode, u8 target_value)
+{
+    block_apply_extended_op(b, ext_opcode, target_value, true);
+}
+
+// src is the neighbour on side s, NULL if there is none
+bool block_read_from_block(block *b, block *src, side s, u8 *out_value)
 {
-    block *src = grid_step_block(g, x, y, s);
     if (src && src->state_halted)
     {
         b->io_blocked = false;
@@ -477,10 +691,8 @@ bool block_try_read_from_neighbor(grid *g, block *b, u8 x, u8 y, side s, u8 *out
     if (!src || !src->bytecode || src->state_halted || src->waiting_ticks || src->current_instruction >= src->length)
         return false;
 
-    instruction src_i = src->bytecode[src->current_instruction];
-    target_t needed_side = to_target(get_opposite_side(s));
-
-    if (src_i.target != needed_side || !is_writing(src_i))
+    const u8 pc = src->current_instruction;
+    if (!block_mask_test(src->names_side[get_opposite_side(s)], pc) || !block_mask_test(src->writing, pc))
     {
         b->io_blocked = true;
         return false;
@@ -488,13 +700,18 @@ bool block_try_read_from_neighbor(grid *g, block *b, u8 x, u8 y, side s, u8 *out
 
     b->io_blocked = false;
     src->io_blocked = false;
-    *out_value = block_get_instruction_write_operand(src, src_i);
+    *out_value = block_get_instruction_write_operand(src, block_peek(src).operation);
     return true;
 }
 
-bool block_try_read_from_slot(grid *g, block *b, u8 x, u8 y, side s, u8 *out_value)
+bool block_try_read_from_neighbor(grid *g, block *b, u8 x, u8 y, side s, u8 *out_value)
+{
+    return block_read_from_block(b, grid_step_block(g, x, y, s), s, out_value);
+}
+
+// slot is the edge slot on the side being read, NULL if the block is not on that edge
+bool block_read_from_slot(block *b, io_slot *slot, u8 *out_value)
 {
-    io_slot *slot = grid_step_edge(g, x, y, s);
     if (!slot || !can_read(slot))
     {
         if (!b->io_blocked)
@@ -506,6 +723,11 @@ bool block_try_read_from_slot(grid *g, block *b, u8 x, u8 y, side s, u8 *out_val
     return true;
 }
 
+bool block_try_read_from_slot(grid *g, block *b, u8 x, u8 y, side s, u8 *out_value)
+{
+    return block_read_from_slot(b, grid_step_edge(g, x, y, s), out_value);
+}
+
 bool block_read_from_io(grid *g, block *b, u8 x, u8 y, side read_side, u8 *out_value)
 {
     if (read_side == any)
@@ -531,94 +753,1634 @@ bool block_read_from_io(grid *g, block *b, u8 x, u8 y, side read_side, u8 *out_v
     return false;
 }
 
-void block_exec_instruction_mono(grid *g, block *b, u8 x, u8 y)
-{
-    if (!b->bytecode || b->state_halted)
-        return;
-
-    g->any_ticked = true;
-
-    if (b->waiting_ticks)
-    {
-        b->waiting_ticks--;
-        return;
-    }
-
-    if (b->current_instruction >= b->length)
-        b->current_instruction = 0;
-
-    const instruction i = b->bytecode[b->current_instruction];
-
-    // printf("%d:%d : %d\t%s\t%s\t%s\t%s\n", x, y, b->current_instruction, op_code_str(i.operation),
-    // target_str(i.target),
-    //        b->io_blocked ? "BK" : "", b->last_caused_overflow ? "OF" : "");
+/*
+    executes an already fetched instruction
 
-    if (i.operation == HALT)
+    operation, target, side and flags always describe d, they are passed separately so the handler table can
+    instantiate this with constants and have the compiler fold away every switch that depends on them
+*/
+static ALWAYS_INLINE void block_exec_decoded(grid *g, block *b, u8 x, u8 y, const decoded_instruction *d,
+                                             const u8 operation, const u8 target, const u8 side, const u8 flags,
+                                             const bool checked)
+{
+    if (operation == HALT)
     {
         b->state_halted = true;
         return;
     }
 
-    u8 advance_to = b->current_instruction + 1;
+    u8 advance_to = b->current_instruction + d->length;
     u8 operand_value = 0;
 
-    u8 transfer_side = block_get_transfer_side(i);
-    bool target_needed = is_target_used(i);
-    bool io_needed = target_needed && (transfer_side != invalid);
-    bool is_writing_op = is_writing(i);
-
-    if (is_writing_op)
+    if (flags & DECODED_WRITING)
     {
-        u8 value = block_get_instruction_write_operand(b, i);
-        if (io_needed)
-            block_write_to_side(g, b, x, y, transfer_side, value);
+        u8 value = operation == PUT ? b->accumulator : checked ? block_pop_stack(b) : b->stack[(u8)b->stack_top--];
+        if (flags & DECODED_IO)
+            block_write_to_side(g, b, x, y, side, value);
         else
-            block_write_to_target(g, b, i, value, &advance_to);
+            block_write_local(g, b, target, value, checked);
     }
     else
     {
-        if (io_needed)
+        if (flags & DECODED_IO)
         {
-            if (block_read_from_io(g, b, x, y, transfer_side, &operand_value))
+            if (block_read_from_io(g, b, x, y, side, &operand_value))
             {
                 b->transfer_value = operand_value;
             }
         }
-        else if (target_needed)
+        else
         {
-            operand_value = block_get_operand_value(b, i, &advance_to);
+            operand_value = block_read_local(b, d, target, checked);
         }
 
-        if (i.operation == EXT) // special case for the extended ops, since none of them "write" at the moment, its in
-                                // the "read" branch
+        if (operation == EXT) // special case for the extended ops, since none of them "write" at the moment, its in
+                              // the "read" branch
+            block_apply_extended_op(b, d->ext_opcode, operand_value, checked);
+        else
+            block_apply_operation(b, operation, operand_value, &advance_to, checked); // exec normally
+    }
+
+    if (!b->io_blocked) // advance if not blocked from doing so
+        b->current_instruction = checked && advance_to >= b->length ? b->length - 1 : advance_to;
+}
+
+#ifdef BLOCKLANG_TABLE_DISPATCH
+
+/*
+    one handler for each of the 256 operation/target pairs, each one is block_exec_decoded with everything but the
+    block state known at compile time: `ADD RG1` ends up as a register load, an add and the overflow check
+
+    verified programs get a second set without the checks the verifier made redundant
+*/
+
+#define TARGET_SIDE(t) ((t) >= UP && (t) <= ANY ? (t) - UP : invalid)
+#define TARGET_FLAGS(op, t)                                                                                            \
+    (DECODED_VALID | ((op) != HALT && TARGET_SIDE(t) != invalid ? DECODED_IO : 0) |                                   \
+     ((op) == PUT || (op) == POP ? DECODED_WRITING : 0))
+
+#define FOR_EACH_OPERATION(X)                                                                                          \
+    X(EXT) X(WAIT) X(ADD) X(SUB) X(MLT) X(DIV) X(MOD) X(GET) X(PUT) X(PUSH) X(POP) X(JMP) X(JEZ) X(JNZ) X(JOF) X(HALT)
+
+#define FOR_EACH_TARGET(X, op)                                                                                         \
+    X(op, STK) X(op, ACC) X(op, RG0) X(op, RG1) X(op, RG2) X(op, RG3) X(op, ADJ) X(op, UP) X(op, RIGHT) X(op, DOWN)    \
+        X(op, LEFT) X(op, ANY) X(op, NIL) X(op, SLN) X(op, CUR) X(op, REF)
+
+typedef void (*block_handler)(grid *g, block *b, u8 x, u8 y, const decoded_instruction *d);
+
+#define DEFINE_HANDLER(op, t)                                                                                          \
+    static void exec_##op##_##t(grid *g, block *b, u8 x, u8 y, const decoded_instruction *d)                          \
+    {                                                                                                                  \
+        block_exec_decoded(g, b, x, y, d, op, t, TARGET_SIDE(t), TARGET_FLAGS(op, t), true);                           \
+    }                                                                                                                  \
+    static void exec_verified_##op##_##t(grid *g, block *b, u8 x, u8 y, const decoded_instruction *d)                 \
+    {                                                                                                                  \
+        block_exec_decoded(g, b, x, y, d, op, t, TARGET_SIDE(t), TARGET_FLAGS(op, t), false);                          \
+    }
+#define DEFINE_HANDLERS(op) FOR_EACH_TARGET(DEFINE_HANDLER, op)
+
+FOR_EACH_OPERATION(DEFINE_HANDLERS)
+
+#define HANDLER_ENTRY(op, t) exec_##op##_##t,
+#define HANDLER_ROW(op) {FOR_EACH_TARGET(HANDLER_ENTRY, op)},
+#define VERIFIED_HANDLER_ENTRY(op, t) exec_verified_##op##_##t,
+#define VERIFIED_HANDLER_ROW(op) {FOR_EACH_TARGET(VERIFIED_HANDLER_ENTRY, op)},
+
+static const block_handler block_handlers[OP_GUARD_LAST][TARGET_GUARD_LAST] = {FOR_EACH_OPERATION(HANDLER_ROW)};
+static const block_handler verified_handlers[OP_GUARD_LAST][TARGET_GUARD_LAST] = {
+    FOR_EACH_OPERATION(VERIFIED_HANDLER_ROW)};
+
+#undef VERIFIED_HANDLER_ROW
+#undef VERIFIED_HANDLER_ENTRY
+#undef HANDLER_ROW
+#undef HANDLER_ENTRY
+#undef DEFINE_HANDLERS
+#undef DEFINE_HANDLER
+#undef FOR_EACH_TARGET
+#undef FOR_EACH_OPERATION
+#undef TARGET_FLAGS
+#undef TARGET_SIDE
+
+#endif
+
+#ifdef BLOCKLANG_SEQUENCE_STATS
+
+/*
+    counts of instruction pairs and triples that ran back to back without a jump in between, over every block and
+    every run of this process. print_sequence_stats dumps them for programs/sequence_stats.sh to merge
+*/
+
+#define SEQUENCE_TRIPLES 4096
+
+typedef struct
+{
+    u8 key; // operation << 4 | target
+    u8 pc;
+    u8 next; // pc the block falls through to
+    bool valid;
+} sequence_entry;
+
+static u32 sequence_pairs[256][256];
+static struct
+{
+    u32 key;
+    u32 count;
+} sequence_triples[SEQUENCE_TRIPLES];
+static u32 sequence_triples_dropped; // new triples seen after the table filled up
+static sequence_entry sequence_history[256][2];
+
+static void sequence_stats_record(grid *g, block *b, const decoded_instruction *d)
+{
+    sequence_entry *h = sequence_history[b - g->blocks];
+    const sequence_entry cur = {
+        .key = d->operation << 4 | d->target,
+        .pc = b->current_instruction,
+        .next = b->current_instruction + d->length,
+        .valid = true,
+    };
+
+    if (h[1].valid && h[1].next == cur.pc)
+    {
+        sequence_pairs[h[1].key][cur.key]++;
+
+        if (h[0].valid && h[0].next == h[1].pc)
         {
-            u8 ext_opcode = ((u8 *)b->bytecode)[b->current_instruction + 1];
-            advance_to++; // jump over ext opcode byte
+            const u32 key = 1u << 24 | h[0].key << 16 | h[1].key << 8 | cur.key;
+            u32 slot = key * 2654435761u % SEQUENCE_TRIPLES;
+            u16 probes = 1;
+            while (sequence_triples[slot].key && sequence_triples[slot].key != key && probes < SEQUENCE_TRIPLES)
+            {
+                slot = (slot + 1) % SEQUENCE_TRIPLES;
+                probes++;
+            }
 
-            block_exec_extended_op(b, ext_opcode, operand_value, &advance_to); // exec
+            if (!sequence_triples[slot].key || sequence_triples[slot].key == key)
+            {
+                sequence_triples[slot].key = key;
+                sequence_triples[slot].count++;
+            }
+            else
+                sequence_triples_dropped++;
         }
-        else
-            block_execute_operation(b, i.operation, operand_value, &advance_to); // exec normally
     }
 
-    if (!b->io_blocked) // advance if not blocked from doing so
-        b->current_instruction = advance_to >= b->length ? b->length - 1 : advance_to;
+    h[0] = h[1];
+    h[1] = cur;
+}
+
+void print_sequence_stats(FILE *f)
+{
+    for (u16 first = 0; first < 256; first++)
+        for (u16 second = 0; second < 256; second++)
+            if (sequence_pairs[first][second])
+                fprintf(f, "pair %s %s %s %s %u\n", op_code_str(first >> 4), target_str(first & 15),
+                        op_code_str(second >> 4), target_str(second & 15), sequence_pairs[first][second]);
+
+    for (u16 slot = 0; slot < SEQUENCE_TRIPLES; slot++)
+    {
+        const u32 key = sequence_triples[slot].key;
+        if (!key)
+            continue;
+        fprintf(f, "triple %s %s %s %s %s %s %u\n", op_code_str(key >> 20 & 15), target_str(key >> 16 & 15),
+                op_code_str(key >> 12 & 15), target_str(key >> 8 & 15), op_code_str(key >> 4 & 15),
+                target_str(key & 15), sequence_triples[slot].count);
+    }
+
+    if (sequence_triples_dropped)
+        fprintf(f, "dropped triples %u\n", sequence_triples_dropped);
+}
+
+#endif
+
+static inline void block_exec_one(grid *g, block *b, u8 x, u8 y, const decoded_instruction *d)
+{
+#ifdef BLOCKLANG_SEQUENCE_STATS
+    sequence_stats_record(g, b, d);
+#endif
+
+#ifdef BLOCKLANG_TABLE_DISPATCH
+    (b->verified ? verified_handlers : block_handlers)[d->operation][d->target](g, b, x, y, d);
+#else
+    if (b->verified)
+        block_exec_decoded(g, b, x, y, d, d->operation, d->target, d->side, d->flags, false);
+    else
+        block_exec_decoded(g, b, x, y, d, d->operation, d->target, d->side, d->flags, true);
+#endif
 }
 
-void run_grid(grid *g, u32 max_ticks)
+/*
+    runs a superinstruction in one go and leaves the block owing a tick for each extra instruction it ran
+
+    while the ticks are paid the block sits at the second instruction of the sequence, which is local like all the
+    rest, so neighbours see it exactly as they would have. stops early when an instruction blocks or jumps, and never
+    runs past the tick limit so the state is exact whenever run_grid returns
+*/
+static void block_exec_fused(grid *g, block *b, u8 x, u8 y, const decoded_instruction *d)
 {
+    const u32 spare_ticks = g->max_ticks > g->ticks ? g->max_ticks - g->ticks : 0;
+    const u8 count = d->fused <= spare_ticks ? d->fused : spare_ticks + 1;
+
+    u8 second = 0;
+    u8 done = 0;
+
     while (true)
     {
-        g->any_ticked = false;
+        const u16 next = b->current_instruction + d->length; // the pattern matched, so this is in bounds
 
-        for (u8 y = 0; y < g->height; y++)
-            for (u8 x = 0; x < g->width; x++)
-                block_exec_instruction_mono(g, &g->blocks[y * g->width + x], x, y);
+        block_exec_one(g, b, x, y, d);
 
-        if (g->any_ticked == false)
-            return;
+        if (++done == 1)
+            second = b->current_instruction;
 
-        if (g->ticks++ >= max_ticks)
-            return;
+        if (done == count || b->io_blocked || b->current_instruction != next)
+            break;
+
+        d = block_fetch(b, b->current_instruction);
+    }
+
+    if (done > 1)
+    {
+        b->fused_resume = b->current_instruction;
+        b->fused_ticks = done - 1;
+        b->current_instruction = second;
+    }
+}
+
+/*
+    tracing: a block that keeps jumping backwards records the loop it is in as the list of addresses it goes through,
+    and from then on follows the list instead of dispatching an instruction per tick
+
+    replaying works like a superinstruction of any length: the instruction the block is at runs in its own tick, then
+    as many of the following local instructions as the trace and the tick limit allow, and the block owes a tick for
+    each of those. every step is guarded by the next address on the trace, a branch going elsewhere or a transfer
+    that is not ready ends the batch with the block exactly where the interpreter would have left it
+*/
+
+#define TRACE_HEAT 16   // backward jumps before the loop is recorded
+#define TRACE_MISSES 16 // branches off the trace before it is dropped for a new one
+
+static void block_trace_drop(block_trace *t)
+{
+    t->state = TRACE_IDLE;
+    t->heat = 0;
+    t->misses = 0;
+}
+
+// safe to run ahead of time: invisible to neighbours, which only look at sides, WAIT and HALT
+static inline bool block_trace_local(const decoded_instruction *d)
+{
+    return !(d->flags & DECODED_IO) && d->operation != WAIT && d->operation != HALT;
+}
+
+// after the instruction at pc ran outside of a trace
+static void block_trace_observe(block *b, u8 pc)
+{
+    block_trace *t = &b->trace;
+    const u8 next = b->current_instruction;
+
+    if (b->io_blocked) // it runs again next tick
+        return;
+
+    switch (t->state)
+    {
+    case TRACE_IDLE:
+        if (next <= pc && ++t->heat >= TRACE_HEAT)
+        {
+            t->state = TRACE_RECORDING;
+            t->anchor = next;
+            t->length = 0;
+        }
+        break;
+    case TRACE_RECORDING:
+        if (b->state_halted || t->length == TRACE_MAX || (t->length == 0 && pc != t->anchor))
+        {
+            block_trace_drop(t);
+            break;
+        }
+        t->pcs[t->length++] = pc;
+        if (next == t->anchor)
+        {
+            t->state = TRACE_READY;
+            t->at = 0;
+        }
+        break;
+    }
+}
+
+// false if the block is not on its trace and has to be interpreted as usual
+static bool block_trace_step(grid *g, block *b, u8 x, u8 y)
+{
+    block_trace *t = &b->trace;
+
+    if (t->state != TRACE_READY)
+        return false;
+
+    if (b->current_instruction != t->pcs[t->at])
+    {
+        if (b->current_instruction != t->anchor)
+            return false;
+        t->at = 0;
+    }
+
+    const u32 spare_ticks = g->max_ticks > g->ticks ? g->max_ticks - g->ticks : 0;
+    const u16 count = spare_ticks < 255 ? spare_ticks + 1 : 255;
+
+    u8 second = 0;
+    u16 done = 0;
+
+    while (true)
+    {
+        const decoded_instruction *d = block_fetch(b, b->current_instruction);
+        if (done && !block_trace_local(d))
+            break;
+
+        block_exec_one(g, b, x, y, d);
+
+        if (++done == 1)
+            second = b->current_instruction;
+
+        if (b->io_blocked || b->state_halted)
+            break;
+
+        const u8 k = t->at + 1 == t->length ? 0 : t->at + 1;
+        if (b->current_instruction != t->pcs[k])
+        {
+            t->at = 0;
+            if (++t->misses >= TRACE_MISSES)
+                block_trace_drop(t);
+            break;
+        }
+
+        t->at = k;
+
+        if (done == count || b->waiting_ticks)
+            break;
+    }
+
+    if (done > 1)
+    {
+        b->fused_resume = b->current_instruction;
+        b->fused_ticks = done - 1;
+        b->current_instruction = second;
+    }
+
+    return true;
+}
+
+/*
+    batching: the instruction the block is at runs in its own tick, then the block keeps going through local
+    instructions for as many ticks as the tick limit leaves (up to 255) and owes a tick for each, like a
+    superinstruction with no fixed shape. an I/O-free program only stops at WAIT and HALT, any other at the next
+    instruction that names a side. takes over from superinstructions and traces, which are the same thing limited to
+    fixed sequences and recorded loops
+*/
+static void block_exec_batch(grid *g, block *b, u8 x, u8 y)
+{
+    const u32 spare_ticks = g->max_ticks > g->ticks ? g->max_ticks - g->ticks : 0;
+    const u16 count = spare_ticks < 255 ? spare_ticks + 1 : 255;
+
+    u8 second = 0;
+    u16 done = 0;
+
+    while (true)
+    {
+        const u8 pc = b->current_instruction;
+        const decoded_instruction *d = b->verified ? &b->decoded[pc] : block_fetch(b, pc);
+        if (done && !block_trace_local(d))
+            break;
+
+        if (!b->jit || !jit_step(b))
+            block_exec_one(g, b, x, y, d);
+
+        if (++done == 1)
+            second = b->current_instruction;
+
+        if (done == count || b->io_blocked || b->state_halted || b->waiting_ticks)
+            break;
+    }
+
+    if (done > 1)
+    {
+        b->fused_resume = b->current_instruction;
+        b->fused_ticks = done - 1;
+        b->current_instruction = second;
+    }
+}
+
+// for translated programs, runs what the translation left out: instructions with operands past the end
+static void block_exec_interpreted(grid *g, block *b, u8 x, u8 y)
+{
+    block_exec_one(g, b, x, y, block_fetch(b, b->current_instruction));
+}
+
+// instruction the block is at, with the pc wrapped like the tick loop does
+const decoded_instruction *block_fetch_current(block *b)
+{
+    if (!b->verified && b->current_instruction >= b->length)
+        b->current_instruction = 0;
+    return block_fetch(b, b->current_instruction);
+}
+
+// d names no side, for schedulers other than the tick loop, see actors.h
+void block_exec_local(grid *g, block *b, u8 x, u8 y, const decoded_instruction *d)
+{
+    block_exec_one(g, b, x, y, d);
+}
+
+void block_exec_instruction_mono(grid *g, block *b, u8 x, u8 y)
+{
+    if (!b->bytecode || b->state_halted)
+        return;
+
+    g->any_ticked = true;
+
+    if (b->waiting_ticks)
+    {
+        b->waiting_ticks--;
+        return;
+    }
+
+    if (b->fused_ticks)
+    {
+        if (--b->fused_ticks == 0)
+            b->current_instruction = b->fused_resume;
+        return;
+    }
+
+    if (!b->verified && b->current_instruction >= b->length)
+        b->current_instruction = 0;
+
+    if (b->native)
+    {
+        b->native->tick(g, b, x, y, &native_vm_api);
+        return;
+    }
+
+    if (b->batchable)
+    {
+        block_exec_batch(g, b, x, y);
+        return;
+    }
+
+    if (b->traceable && block_trace_step(g, b, x, y))
+        return;
+
+    const u8 pc = b->current_instruction;
+    // a verified program only reaches instructions that were decoded at load and can never change
+    const decoded_instruction *d = b->verified ? &b->decoded[pc] : block_fetch(b, pc);
+
+    // printf("%d:%d : %d\t%s\t%s\t%s\t%s\n", x, y, b->current_instruction, op_code_str(d->operation),
+    // target_str(d->target),
+    //        b->io_blocked ? "BK" : "", b->last_caused_overflow ? "OF" : "");
+
+    if (d->fused > 1 && b->fusable && b->trace.state != TRACE_RECORDING)
+    {
+        block_exec_fused(g, b, x, y, d);
+        return;
+    }
+
+    if (!b->jit || !jit_step(b))
+        block_exec_one(g, b, x, y, d);
+
+    if (b->traceable)
+        block_trace_observe(b, pc);
+}
+
+const native_api native_vm_api = {
+    .read_from_io = block_read_from_io,
+    .write_to_side = block_write_to_side,
+    .pop_stack = block_pop_stack,
+    .interpret = block_exec_interpreted,
+    .read_from_block = block_read_from_block,
+    .read_from_slot = block_read_from_slot,
+    .write_to_neighbour = block_write_to_neighbour,
+    .write_to_slot = block_write_to_slot,
+    .exec_block = block_exec_instruction_mono,
+};
+
+/*
+    parking: a block blocked on a transfer with a neighbour runs the same instruction again every tick. once it has
+    run blocked, running it again changes nothing as long as the neighbour stays where it is and nobody unblocks it,
+    unless it pushes or pops, so the tick loop skips it until the neighbour's own tick changes what a transfer looks
+    at or finishes the transfer. slots never block, so only neighbours are waited on
+*/
+
+// ticks the block will only count down, a wait or what it owes for instructions it ran ahead (never both)
+static inline u8 block_idle_ticks(const block *b)
+{
+    return b->waiting_ticks ? b->waiting_ticks : b->fused_ticks;
+}
+
+// what block_read_from_block and block_write_to_block_direct look at in a neighbour, besides its program
+typedef struct
+{
+    u8 pc;
+    bool waiting;
+    bool halted;
+} block_view;
+
+static inline block_view block_view_of(const block *b)
+{
+    return (block_view){.pc = b->current_instruction, .waiting = b->waiting_ticks != 0, .halted = b->state_halted};
+}
+
+// b at x, y just had its tick, parks it if it is blocked on a neighbour and running it again is known to do nothing
+static void grid_park(grid *g, block *b, u8 x, u8 y)
+{
+    if (!b->io_blocked || b->waiting_ticks || b->fused_ticks || b->self_modifying)
+        return;
+
+    const decoded_instruction *d = block_fetch(b, b->current_instruction);
+    if (!(d->flags & DECODED_IO) || d->side == any || d->operation == PUSH || d->operation == POP)
+        return;
+
+    // a self-modifying neighbour can change the instruction it shows without moving
+    block *peer = grid_step_block(g, x, y, d->side);
+    if (!peer || peer->self_modifying)
+        return;
+
+    b->parked = true;
+    peer->watchers |= 1 << get_opposite_side(d->side);
+    g->parked_count++;
+}
+
+// peer at x, y just had its tick, wakes the neighbours parked on it if anything they depend on changed
+static void grid_wake_watchers(grid *g, block *peer, u8 x, u8 y, block_view before)
+{
+    const block_view after = block_view_of(peer);
+    const bool changed = before.pc != after.pc || before.waiting != after.waiting || before.halted != after.halted;
+
+    for (side s = up; s <= left; s++)
+    {
+        if (!(peer->watchers & (1 << s)))
+            continue;
+
+        block *watcher = grid_step_block(g, x, y, s);
+        if (!watcher) // only a neighbour parks on the block, nothing to wake
+        {
+            peer->watchers &= ~(1 << s);
+            continue;
+        }
+        if (changed || !watcher->io_blocked) // the peer moved, or finished the transfer during its tick
+        {
+            watcher->parked = false;
+            peer->watchers &= ~(1 << s);
+            g->parked_count--;
+        }
+    }
+}
+
+#if defined(BLOCKLANG_THREADED_DISPATCH) && defined(BLOCKLANG_TABLE_DISPATCH)
+#error "pick one of BLOCKLANG_THREADED_DISPATCH and BLOCKLANG_TABLE_DISPATCH"
+#endif
+
+#ifdef BLOCKLANG_THREADED_DISPATCH
+
+#ifndef __GNUC__
+#error "BLOCKLANG_THREADED_DISPATCH needs labels as values (gcc or clang)"
+#endif
+
+/*
+    same tick as calling block_exec_instruction_mono on every block in row-major order, but every operation has its
+    own handler and every handler finds the next runnable block and jumps straight into its handler, so there is one
+    indirect branch per handler instead of a shared chain of switches
+*/
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+static void grid_tick_threaded(grid *g)
+{
+    static void *const dispatch[OP_GUARD_LAST] = {
+        &&op_ext, &&op_wait, &&op_add,  &&op_sub,  &&op_mlt, &&op_div, &&op_mod, &&op_get,
+        &&op_put, &&op_push, &&op_pop,  &&op_jmp,  &&op_jez, &&op_jnz, &&op_jof, &&op_halt,
+    };
+
+    u16 i = 0;
+    u16 kept = 0;
+    u8 soonest = 255;
+    u8 x = 0, y = 0;
+    block *b = &g->blocks[0];
+    block_view before;
+    const decoded_instruction *d;
+    u8 advance_to;
+    u8 operand_value;
+
+// finds the first runnable block starting at live entry i, ticks the idle ones on the way (a wait running out wakes the
+// neighbours parked on the block) and jumps into its handler. blocks with native code, batches, superinstructions,
+// traces or JIT code take their tick through block_exec_instruction_mono on the way instead
+
+#define DISPATCH()                                                                                                     \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        for (;; i++)                                                                                                   \
+        {                                                                                                              \
+            if (i >= g->live_count)                                                                                    \
+            {                                                                                                          \
+                g->live_count = kept;                                                                                  \
+                g->soonest_wake = kept ? soonest : 0;                                                                  \
+                return;                                                                                                \
+            }                                                                                                          \
+            b = &g->blocks[g->live[i].index];                                                                          \
+            g->live[kept++] = g->live[i];                                                                              \
+            x = g->live[i].x;                                                                                          \
+            y = g->live[i].y;                                                                                          \
+            g->any_ticked = true;                                                                                      \
+            if (b->waiting_ticks)                                                                                      \
+            {                                                                                                          \
+                before = block_view_of(b);                                                                             \
+                if (--b->waiting_ticks < soonest)                                                                      \
+                    soonest = b->waiting_ticks;                                                                        \
+                if (b->watchers)                                                                                       \
+                    grid_wake_watchers(g, b, x, y, before);                                                            \
+                continue;                                                                                              \
+            }                                                                                                          \
+            if (b->parked)                                                                                             \
+            {                                                                                                          \
+                soonest = 0;                                                                                           \
+                continue;                                                                                              \
+            }                                                                                                          \
+            if (b->native || b->batchable || b->fusable || b->traceable || b->fused_ticks || b->jit)                   \
+            {                                                                                                          \
+                before = block_view_of(b);                                                                             \
+                block_exec_instruction_mono(g, b, x, y);                                                               \
+                if (b->watchers)                                                                                       \
+                    grid_wake_watchers(g, b, x, y, before);                                                            \
+                if (b->state_halted)                                                                                   \
+                {                                                                                                      \
+                    kept--;                                                                                            \
+                    continue;                                                                                          \
+                }                                                                                                      \
+                if (block_idle_ticks(b) < soonest)                                                                     \
+                    soonest = block_idle_ticks(b);                                                                     \
+                grid_park(g, b, x, y);                                                                                 \
+                continue;                                                                                              \
+            }                                                                                                          \
+            break;                                                                                                     \
+        }                                                                                                              \
+        before = block_view_of(b);                                                                                     \
+        if (!b->verified && b->current_instruction >= b->length)                                                       \
+            b->current_instruction = 0;                                                                                \
+        d = b->verified ? &b->decoded[b->current_instruction] : block_fetch(b, b->current_instruction);                \
+        advance_to = b->current_instruction + d->length;                                                               \
+        operand_value = 0;                                                                                             \
+        goto *dispatch[d->operation];                                                                                  \
+    } while (0)
+
+// advances the block that just ran, moves to the next one and dispatches it
+#define NEXT()                                                                                                         \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!b->io_blocked)                                                                                            \
+            b->current_instruction = advance_to >= b->length ? b->length - 1 : advance_to;                             \
+        if (b->waiting_ticks < soonest)                                                                                \
+            soonest = b->waiting_ticks;                                                                                \
+        if (b->watchers)                                                                                               \
+            grid_wake_watchers(g, b, x, y, before);                                                                    \
+        grid_park(g, b, x, y);                                                                                         \
+        i++;                                                                                                           \
+        DISPATCH();                                                                                                    \
+    } while (0)
+
+#define READ_OPERAND()                                                                                                 \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (d->flags & DECODED_IO)                                                                                     \
+        {                                                                                                              \
+            if (block_read_from_io(g, b, x, y, d->side, &operand_value))                                               \
+                b->transfer_value = operand_value;                                                                     \
+        }                                                                                                              \
+        else                                                                                                           \
+            operand_value = block_get_operand_value(b, d);                                                             \
+    } while (0)
+
+#define WRITE_OPERAND(value)                                                                                           \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (d->flags & DECODED_IO)                                                                                     \
+            block_write_to_side(g, b, x, y, d->side, (value));                                                         \
+        else                                                                                                           \
+            block_write_to_target(g, b, d, (value));                                                                   \
+    } while (0)
+
+    DISPATCH();
+
+op_ext:
+    READ_OPERAND();
+    block_exec_extended_op(b, d->ext_opcode, operand_value);
+    NEXT();
+op_wait:
+    READ_OPERAND();
+    b->waiting_ticks = operand_value;
+    NEXT();
+op_add:
+    READ_OPERAND();
+    b->last_caused_overflow = b->accumulator + operand_value > 255;
+    b->accumulator = b->accumulator + operand_value;
+    NEXT();
+op_sub:
+    READ_OPERAND();
+    b->last_caused_overflow = b->accumulator < operand_value;
+    b->accumulator = b->accumulator - operand_value;
+    NEXT();
+op_mlt:
+    READ_OPERAND();
+    b->last_caused_overflow = b->accumulator * operand_value > 255;
+    b->accumulator = b->accumulator * operand_value;
+    NEXT();
+op_div:
+    READ_OPERAND();
+    b->last_caused_overflow = operand_value == 0;
+    if (operand_value != 0)
+        b->accumulator = b->accumulator / operand_value;
+    NEXT();
+op_mod:
+    READ_OPERAND();
+    b->last_caused_overflow = operand_value == 0;
+    if (operand_value != 0)
+        b->accumulator = b->accumulator % operand_value;
+    NEXT();
+op_get:
+    READ_OPERAND();
+    b->accumulator = operand_value;
+    NEXT();
+op_put:
+    WRITE_OPERAND(b->accumulator);
+    NEXT();
+op_push:
+    READ_OPERAND();
+    if (b->stack_top >= 15)
+        b->last_caused_overflow = true;
+    else
+        b->stack[(u8)++b->stack_top] = operand_value;
+    NEXT();
+op_pop:
+    WRITE_OPERAND(block_pop_stack(b));
+    NEXT();
+op_jmp:
+    READ_OPERAND();
+    advance_to = operand_value;
+    NEXT();
+op_jez:
+    READ_OPERAND();
+    if (b->accumulator == 0)
+        advance_to = operand_value;
+    NEXT();
+op_jnz:
+    READ_OPERAND();
+    if (b->accumulator != 0)
+        advance_to = operand_value;
+    NEXT();
+op_jof:
+    READ_OPERAND();
+    if (b->last_caused_overflow)
+    {
+        advance_to = operand_value;
+        b->last_caused_overflow = false;
+    }
+    NEXT();
+op_halt:
+    b->state_halted = true;
+    kept--; // it was the last one kept
+    if (b->watchers)
+        grid_wake_watchers(g, b, x, y, before);
+    i++;
+    DISPATCH();
+
+#undef DISPATCH
+#undef NEXT
+#undef READ_OPERAND
+#undef WRITE_OPERAND
+}
+
+#pragma GCC diagnostic pop
+
+#else
+
+// block_exec_instruction_mono on every live block, dropping the ones that halted during their tick
+static void grid_tick_live(grid *g)
+{
+    u16 kept = 0;
+    u8 soonest = 255;
+
+    for (u16 i = 0; i < g->live_count; i++)
+    {
+        const live_block live = g->live[i];
+        block *b = &g->blocks[live.index];
+
+        if (b->parked)
+        {
+            g->any_ticked = true;
+            g->live[kept++] = live;
+            soonest = 0;
+            continue;
+        }
+
+        const block_view before = block_view_of(b);
+        block_exec_instruction_mono(g, b, live.x, live.y);
+
+        if (b->watchers)
+            grid_wake_watchers(g, b, live.x, live.y, before);
+
+        if (b->state_halted)
+            continue;
+
+        g->live[kept++] = live;
+        if (block_idle_ticks(b) < soonest)
+            soonest = block_idle_ticks(b);
+        grid_park(g, b, live.x, live.y);
+    }
+
+    g->live_count = kept;
+    g->soonest_wake = kept ? soonest : 0;
+}
+
+#endif
+
+/*
+    two-phase ticks, with grid.two_phase: every live block first posts what it is about to do (a read or write on a
+    side, with the value, or something local) looking only at the state the last tick left, and only once all of them
+    have does any of them carry it out. a transfer between neighbours goes through when both posted matching halves of
+    it, so it no longer matters which of the two comes first in row-major order and each tick is a function of the
+    state before it alone. a value written in one tick is seen by the reader at the end of that same tick, in either
+    direction.
+
+    where this differs from the row-major tick:
+    - a transfer with a neighbour that has a program and has not halted waits for it, whatever the neighbour is doing.
+      a blocked instruction does nothing at all (no operand 0, no pop) and runs again the next tick
+    - a transfer with a neighbour without a program or that halted, or with a slot that cannot be read or written,
+      sets the overflow flag and goes on with 0, or with the value it would have written lost
+    - ANY reads take the first neighbour in side order that writes to them, then the first readable slot, and wait if
+      there is neither but some neighbour still runs. ANY writes go to the first writable slot
+    - PUT and POP through REF and ADJ write the byte after every block had its tick, in row-major order, so no block sees
+      another block's write in the tick it happens
+
+    nothing is parked, fused, traced, batched or run natively. a tick in which every block only stayed blocked leaves
+    the next one the same, so run_grid returns GRID_DEADLOCK with all of them parked for print_deadlock
+
+    the two halves only touch the block they are run for, its edge slots and the intents, so run_grid_parallel runs
+    them over bands of rows at once, see parallel.h
+*/
+static void block_post_intent(block *b, block_intent *i)
+{
+    i->stores = false;
+
+    if (b->waiting_ticks || b->fused_ticks)
+    {
+        i->kind = INTENT_LOCAL;
+        return;
+    }
+
+    const u8 pc = !b->verified && b->current_instruction >= b->length ? 0 : b->current_instruction;
+    const decoded_instruction *d = block_fetch(b, pc);
+
+    if (!(d->flags & DECODED_IO))
+    {
+        i->kind = INTENT_LOCAL;
+        return;
+    }
+
+    i->kind = d->flags & DECODED_WRITING ? INTENT_WRITE : INTENT_READ;
+    i->side = d->side;
+    if (d->operation == PUT)
+        i->value = b->accumulator;
+    else
+        i->value = b->stack_top >= 0 ? b->stack[(u8)b->stack_top] : 0;
+}
+
+// what the neighbour on side s of the block at n posted, NULL if there is none
+static inline const block_intent *grid_peer_intent(const grid *g, u16 n, side s)
+{
+    const block *peer = g->links[n].neighbour[s];
+    return peer ? &g->intents[peer - g->blocks] : NULL;
+}
+
+// side of the first neighbour of the block at n that posted a write to it, invalid if none did
+static side grid_first_writer(const grid *g, u16 n)
+{
+    for (side s = up; s <= left; s++)
+    {
+        const block_intent *p = grid_peer_intent(g, n, s);
+        if (p && p->kind == INTENT_WRITE && p->side == get_opposite_side(s))
+            return s;
+    }
+    return invalid;
+}
+
+static u8 grid_resolve_read(grid *g, u16 n, side s, u8 *value)
+{
+    const block_links *l = &g->links[n];
+
+    if (s == any)
+    {
+        const side from = grid_first_writer(g, n);
+        const block_intent *writer = from != invalid ? grid_peer_intent(g, n, from) : NULL;
+        if (writer)
+        {
+            *value = writer->value;
+            return TRANSFER_DONE;
+        }
+
+        for (side e = up; e <= left; e++)
+            if (l->slot[e] && can_read(l->slot[e]))
+            {
+                *value = read_byte(l->slot[e]);
+                return TRANSFER_DONE;
+            }
+
+        for (side e = up; e <= left; e++)
+        {
+            const block_intent *p = grid_peer_intent(g, n, e);
+            if (p && p->kind != INTENT_ABSENT)
+                return TRANSFER_BLOCKED;
+        }
+        return TRANSFER_FAILED;
+    }
+
+    const block_intent *p = grid_peer_intent(g, n, s);
+    if (p)
+    {
+        if (p->kind == INTENT_ABSENT)
+            return TRANSFER_FAILED;
+        if (p->kind != INTENT_WRITE || p->side != get_opposite_side(s))
+            return TRANSFER_BLOCKED;
+
+        *value = p->value;
+        return TRANSFER_DONE;
+    }
+
+    if (!l->slot[s] || !can_read(l->slot[s]))
+        return TRANSFER_FAILED;
+
+    *value = read_byte(l->slot[s]);
+    return TRANSFER_DONE;
+}
+
+static u8 grid_resolve_write(grid *g, u16 n, side s, u8 value)
+{
+    const block_links *l = &g->links[n];
+
+    if (s == any)
+    {
+        for (side e = up; e <= left; e++)
+            if (block_write_to_slot(l->slot[e], value))
+                return TRANSFER_DONE;
+        return TRANSFER_FAILED;
+    }
+
+    if (l->neighbour[s])
+    {
+        const u16 peer = l->neighbour[s] - g->blocks;
+        const block_intent *p = &g->intents[peer];
+        const side back = get_opposite_side(s);
+
+        if (p->kind == INTENT_ABSENT)
+            return TRANSFER_FAILED;
+        if (p->kind == INTENT_READ && (p->side == back || (p->side == any && grid_first_writer(g, peer) == back)))
+            return TRANSFER_DONE;
+        return TRANSFER_BLOCKED;
+    }
+
+    return block_write_to_slot(l->slot[s], value) ? TRANSFER_DONE : TRANSFER_FAILED;
+}
+
+// the rest of a transfer instruction once it went through (value is what a read got) or failed
+void block_finish_transfer(block *b, const decoded_instruction *d, u8 result, u8 value)
+{
+    b->io_blocked = false;
+    if (result == TRANSFER_FAILED)
+        b->last_caused_overflow = true;
+
+    u8 advance_to = b->current_instruction + d->length;
+
+    if (d->flags & DECODED_WRITING)
+    {
+        if (d->operation == POP)
+            block_pop_stack(b);
+    }
+    else
+    {
+        if (result == TRANSFER_DONE)
+            b->transfer_value = value;
+
+        if (d->operation == EXT)
+            block_apply_extended_op(b, d->ext_opcode, value, true);
+        else
+            block_apply_operation(b, d->operation, value, &advance_to, true);
+    }
+
+    b->current_instruction = advance_to >= b->length ? b->length - 1 : advance_to;
+}
+
+// PUT or POP through REF or ADJ, the byte is left in the intent for grid_tick_two_phase to write
+static void block_defer_store(block *b, block_intent *i, const decoded_instruction *d)
+{
+    const u8 value = d->operation == PUT ? b->accumulator : block_pop_stack(b);
+
+    if (d->target == ADJ)
+    {
+        i->stores = true;
+        i->store_addr = b->current_instruction + 1;
+        i->store_value = value;
+    }
+    else
+    {
+        const bool toofar = value > b->length;
+        b->last_caused_overflow = toofar;
+        i->stores = !toofar;
+        i->store_addr = value;
+        i->store_value = b->registers[3];
+    }
+
+    const u8 advance_to = b->current_instruction + d->length;
+    b->current_instruction = advance_to >= b->length ? b->length - 1 : advance_to;
+}
+
+// second half of the tick for the live block at n, false if all it did was stay blocked as it already was
+static bool block_commit_intent(grid *g, block *b, u16 n, u8 x, u8 y)
+{
+    block_intent *i = &g->intents[n];
+    b->parked = false;
+
+    if (b->waiting_ticks)
+    {
+        b->waiting_ticks--;
+        return true;
+    }
+
+    if (b->fused_ticks) // left over from a run without two-phase ticks
+    {
+        if (--b->fused_ticks == 0)
+            b->current_instruction = b->fused_resume;
+        return true;
+    }
+
+    if (!b->verified && b->current_instruction >= b->length)
+        b->current_instruction = 0;
+
+    const decoded_instruction *d = block_fetch(b, b->current_instruction);
+
+    if (i->kind == INTENT_LOCAL)
+    {
+        if ((d->flags & DECODED_WRITING) && (d->target == REF || d->target == ADJ))
+            block_defer_store(b, i, d);
+        else
+            block_exec_one(g, b, x, y, d);
+        return true;
+    }
+
+    u8 value = 0;
+    const u8 result = i->kind == INTENT_READ ? grid_resolve_read(g, n, i->side, &value)
+                                             : grid_resolve_write(g, n, i->side, i->value);
+
+    if (result == TRANSFER_BLOCKED)
+    {
+        const bool already = b->io_blocked;
+        b->io_blocked = true;
+        return !already;
+    }
+
+    block_finish_transfer(b, d, result, value);
+    return true;
+}
+
+void grid_post_intents(grid *g, u16 from, u16 to)
+{
+    for (u16 i = from; i < to; i++)
+        block_post_intent(&g->blocks[g->live[i].index], &g->intents[g->live[i].index]);
+}
+
+bool grid_commit_intents(grid *g, u16 from, u16 to)
+{
+    bool changed = false;
+    for (u16 i = from; i < to; i++)
+    {
+        const live_block live = g->live[i];
+        changed |= block_commit_intent(g, &g->blocks[live.index], live.index, live.x, live.y);
+    }
+    return changed;
+}
+
+void grid_finish_two_phase(grid *g, bool changed)
+{
+    g->any_ticked = g->live_count != 0;
+
+    u16 kept = 0;
+    u8 soonest = 255;
+
+    for (u16 i = 0; i < g->live_count; i++)
+    {
+        const live_block live = g->live[i];
+        block *b = &g->blocks[live.index];
+        block_intent *in = &g->intents[live.index];
+
+        if (in->stores)
+        {
+            ((u8 *)(b->bytecode))[in->store_addr] = in->store_value;
+            grid_invalidate_decoded(g, b->bytecode, in->store_addr);
+        }
+
+        if (b->state_halted)
+        {
+            in->kind = INTENT_ABSENT;
+            continue;
+        }
+
+        g->live[kept++] = live;
+        if (block_idle_ticks(b) < soonest)
+            soonest = block_idle_ticks(b);
+        b->parked = !changed;
+    }
+
+    g->live_count = kept;
+    g->parked_count = changed ? 0 : kept;
+    g->soonest_wake = kept ? soonest : 0;
+}
+
+static void grid_tick_two_phase(grid *g)
+{
+    grid_post_intents(g, 0, g->live_count);
+    grid_finish_two_phase(g, grid_commit_intents(g, 0, g->live_count));
+}
+
+// blocks that are not live post nothing, the live ones post again every tick
+static void grid_clear_intents(grid *g)
+{
+    for (u16 n = 0; n < g->width * g->height; n++)
+        g->intents[n].kind = INTENT_ABSENT;
+}
+
+/*
+    dead blocks: a block only changes a neighbour through a transfer the neighbour names the side of (anything else
+    leaves the neighbour as it is, timing included), and only writes to a slot on a side it names itself. a block that
+    no chain of such sides leads from to an output slot cannot change what ends up in any output or when, so with
+    grid.prune it is left out of the live list and keeps the state it has. blocks running a self-modifying program
+    also reach every other block running it, through the bytecode they share
+
+    sides come from block.sides_used, so instructions that can never run do not count
+*/
+static void grid_mark_relevant(grid *g, bool *relevant)
+{
+    const u16 total = g->width * g->height;
+    u8 worklist[256];
+    u16 pending = 0;
+
+    for (u16 n = 0; n < total; n++)
+    {
+        const block *b = &g->blocks[n];
+        if (!b->bytecode)
+            continue;
+
+        for (side s = up; s <= left && !relevant[n]; s++)
+        {
+            const io_slot *slot = grid_step_edge(g, n % g->width, n / g->width, s);
+            if (slot && !slot->read_only && slot->len && (b->sides_used & ((1 << s) | (1 << any))))
+                relevant[n] = true;
+        }
+
+        if (relevant[n])
+            worklist[pending++] = n;
+    }
+
+    while (pending)
+    {
+        const u16 n = worklist[--pending];
+        const block *b = &g->blocks[n];
+
+        for (side s = up; s <= left; s++)
+        {
+            const block *o = grid_step_block(g, n % g->width, n / g->width, s);
+            if (!o || !o->bytecode || !(b->sides_used & ((1 << s) | (1 << any))))
+                continue;
+
+            const u16 other = o - g->blocks;
+            if (!relevant[other])
+            {
+                relevant[other] = true;
+                worklist[pending++] = other;
+            }
+        }
+
+        for (u16 other = 0; b->self_modifying && other < total; other++)
+            if (!relevant[other] && g->blocks[other].bytecode == b->bytecode)
+            {
+                relevant[other] = true;
+                worklist[pending++] = other;
+            }
+    }
+}
+
+// blocks in row-major order that have a program and have not halted, parked ones run again since programs changed
+static void grid_collect_live(grid *g)
+{
+    const bool prune = g->prune && !g->native;
+    bool relevant[256] = {0};
+
+    if (prune)
+        grid_mark_relevant(g, relevant);
+
+    g->live_count = 0;
+    g->parked_count = 0;
+
+    for (u8 y = 0; y < g->height; y++)
+        for (u8 x = 0; x < g->width; x++)
+        {
+            const u16 n = y * g->width + x;
+            block *b = &g->blocks[n];
+            b->parked = false;
+            b->watchers = 0;
+            b->pruned = prune && b->bytecode && !b->state_halted && !relevant[n];
+            if (b->bytecode && !b->state_halted && !b->pruned)
+                g->live[g->live_count++] = (live_block){.index = n, .x = x, .y = y};
+        }
+
+    g->live_dirty = false;
+}
+
+// for ticks that did not go through the live list, see grid.soonest_wake
+static u8 grid_soonest_wake(const grid *g)
+{
+    u8 soonest = 0;
+
+    for (u16 i = 0; i < g->live_count; i++)
+    {
+        const block *b = &g->blocks[g->live[i].index];
+        if (b->state_halted)
+            continue;
+        if (!block_idle_ticks(b))
+            return 0;
+        if (!soonest || block_idle_ticks(b) < soonest)
+            soonest = block_idle_ticks(b);
+    }
+
+    return soonest;
+}
+
+/*
+    every live block is waiting or paying for instructions it ran ahead, so all the next grid.soonest_wake ticks would
+    do is count those down: does that in one go, stopping at max_ticks exactly where the tick loop would. true if
+    run_grid has to stop
+*/
+static bool grid_fast_forward(grid *g, u32 max_ticks)
+{
+    const u32 left = max_ticks - g->ticks; // ticks after the next one that are still allowed
+    const u32 skip = g->soonest_wake <= left ? g->soonest_wake : left + 1;
+
+    for (u16 i = 0; i < g->live_count; i++)
+    {
+        block *b = &g->blocks[g->live[i].index];
+        if (b->state_halted)
+            continue;
+
+        if (b->waiting_ticks)
+            b->waiting_ticks -= skip;
+        else if ((b->fused_ticks -= skip) == 0)
+            b->current_instruction = b->fused_resume;
+    }
+
+    g->ticks += skip;
+    return g->ticks > max_ticks;
+}
+
+/*
+    superinstructions, traces and batches run ahead of the ticks they are charged for, which is only safe if no other block can
+    rewrite the instructions in between: either the program never writes to itself or this block is the only one
+    running it
+
+    blocks loaded since the last run get their native code here
+*/
+static void grid_prepare_blocks(grid *g)
+{
+    const u16 total = g->width * g->height;
+#ifdef BLOCKLANG_SEQUENCE_STATS
+    // JIT code does not go through block_exec_one, so counting builds interpret everything
+    const bool jit = false;
+#else
+    const bool jit = g->jit && jit_supported();
+#endif
+
+    for (u16 n = 0; n < total; n++)
+    {
+        block *b = &g->blocks[n];
+
+        if (jit && b->bytecode && !b->jit)
+            jit_compile_block(b);
+        else if (!jit && b->jit)
+            jit_release_block(b);
+
+        bool safe = b->bytecode != NULL;
+
+        if (safe && b->self_modifying)
+            for (u16 other = 0; other < total && safe; other++)
+                if (other != n && g->blocks[other].bytecode == b->bytecode)
+                    safe = false;
+
+        b->batchable = g->batch && safe;
+        b->fusable = g->fuse && safe && !b->batchable;
+        b->traceable = g->trace && safe && !b->batchable;
+    }
+}
+
+/*
+    cycle detection: without slot I/O and self-modifying programs, the live blocks after a tick decide everything that
+    happens after it. once the grid is back in a state it was in p ticks earlier it goes round the same p ticks until
+    max_ticks, so run_grid skips as many whole rounds as still fit and runs the rest, ending where stepping through
+    every tick would.
+
+    repeats are found with Brent's algorithm over a hash of the live blocks taken after each tick: the state after one
+    tick is kept as a checkpoint, the following ones are compared against it and it moves up to the current one each
+    time the ticks since it reach the next power of two. a matching hash is confirmed field by field, and ticks after
+    which a block still owes ticks for a superinstruction are left out since its registers are ahead of its pc
+
+    ticks in which a slot cursor moved are not hashed at all. each time slot I/O drops a checkpoint the ticks without
+    I/O needed before the next one is taken double, so a grid that keeps reading or writing soon only pays for summing
+    the cursors. no repeat within CYCLE_MAX_PERIOD ticks of a checkpoint and the run stops looking
+*/
+
+#define CYCLE_MAX_PERIOD (1u << 16)
+#define CYCLE_MAX_BACKOFF 4096
+typedef struct
+{
+    u8 pc, accumulator, waiting_ticks, transfer_value, io_blocked, halted, overflow;
+    i8 stack_top;
+    u8 registers[4];
+    u8 stack[16];
+} block_state;
+
+typedef struct
+{
+    bool armed;    // a checkpoint is kept
+    bool given_up; // no repeat within CYCLE_MAX_PERIOD
+    u32 ticks;     // grid.ticks it was taken at
+    u32 power;     // ticks after it at which it moves up
+    u32 io;        // slot cursors summed, they only ever grow
+    u32 quiet;     // ticks since io last changed
+    u32 backoff;   // quiet ticks needed before a checkpoint is taken
+    u64 hash;
+    u16 live_count;
+    block_state blocks[256];
+} grid_cycle;
+
+static inline block_state block_state_of(const block *b)
+{
+    block_state s = {
+        .pc = b->current_instruction,
+        .accumulator = b->accumulator,
+        .waiting_ticks = b->waiting_ticks,
+        .transfer_value = b->transfer_value,
+        .io_blocked = b->io_blocked,
+        .halted = b->state_halted,
+        .overflow = b->last_caused_overflow,
+        .stack_top = b->stack_top,
+    };
+    memcpy(s.registers, b->registers, sizeof(s.registers));
+    memcpy(s.stack, b->stack, sizeof(s.stack));
+    return s;
+}
+
+static u32 grid_io_position(const grid *g)
+{
+    u32 sum = 0;
+    for (u16 n = 0; n < (g->width + g->height) * 2; n++)
+        sum += g->slots[n].cur;
+    return sum;
+}
+
+static bool grid_matches_checkpoint(const grid *g, const grid_cycle *c)
+{
+    for (u16 i = 0; i < g->live_count; i++)
+    {
+        const block_state s = block_state_of(&g->blocks[g->live[i].index]);
+        if (memcmp(&s, &c->blocks[i], sizeof(block_state)))
+            return false;
+    }
+    return true;
+}
+
+// one step of Brent's algorithm after a tick, true if the grid is in the checkpoint's state again
+static bool grid_cycle_step(grid *g, grid_cycle *c)
+{
+    if (c->given_up)
+        return false;
+
+    const u32 io = grid_io_position(g);
+    if (io != c->io) // nothing from before the transfer can come back
+    {
+        if (c->armed && c->backoff < CYCLE_MAX_BACKOFF)
+            c->backoff = c->backoff ? c->backoff * 2 : 1;
+        c->armed = false;
+        c->io = io;
+        c->quiet = 0;
+        return false;
+    }
+
+    if (!c->armed && ++c->quiet < c->backoff)
+        return false;
+
+    u64 hash = 14695981039346656037ull;
+    for (u16 i = 0; i < g->live_count; i++)
+    {
+        const block *b = &g->blocks[g->live[i].index];
+        if (b->fused_ticks)
+            return false;
+
+        const block_state s = block_state_of(b);
+        for (u8 n = 0; n < sizeof(block_state); n += sizeof(u32))
+        {
+            u32 word;
+            memcpy(&word, (const u8 *)&s + n, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ull;
+        }
+    }
+
+    if (c->armed && hash == c->hash && g->live_count == c->live_count && grid_matches_checkpoint(g, c))
+        return true;
+
+    if (c->armed && g->ticks - c->ticks < c->power)
+        return false;
+
+    if (c->armed && c->power >= CYCLE_MAX_PERIOD)
+    {
+        c->given_up = true;
+        return false;
+    }
+
+    c->power = c->armed ? c->power * 2 : 1;
+    c->armed = true;
+    c->ticks = g->ticks;
+    c->io = io;
+    c->hash = hash;
+    c->live_count = g->live_count;
+    for (u16 i = 0; i < g->live_count; i++)
+        c->blocks[i] = block_state_of(&g->blocks[g->live[i].index]);
+    return false;
+}
+
+static bool grid_cycles_possible(const grid *g)
+{
+    for (u16 i = 0; i < g->live_count; i++)
+        if (g->blocks[g->live[i].index].self_modifying)
+            return false;
+    return g->cycles;
+}
+
+// fresh if this is a new run, otherwise history_restore put the grid back to a checkpoint of one
+static grid_status grid_run(grid *g, u32 max_ticks, bool fresh)
+{
+    g->max_ticks = max_ticks;
+    grid_prepare_blocks(g);
+
+    if (g->live_dirty)
+        grid_collect_live(g);
+
+    if (fresh)
+        history_begin(g, max_ticks);
+
+    if (g->two_phase)
+        grid_clear_intents(g);
+
+    grid_cycle cycle = {.armed = false};
+    bool detect_cycles = grid_cycles_possible(g);
+
+    while (true)
+    {
+        history_tick(g);
+        g->any_ticked = false;
+
+        if (g->two_phase && g->pool)
+            parallel_tick(g);
+        else if (g->two_phase)
+            grid_tick_two_phase(g);
+        else if (g->native)
+        {
+            g->native->tick(g, &native_vm_api);
+            g->soonest_wake = grid_soonest_wake(g);
+        }
+        else
+        {
+#ifdef BLOCKLANG_THREADED_DISPATCH
+            grid_tick_threaded(g);
+#else
+            grid_tick_live(g);
+#endif
+        }
+
+        if (g->any_ticked == false)
+            return GRID_IDLE;
+
+        if (g->ticks++ >= max_ticks)
+            return GRID_TICK_LIMIT;
+
+        // parked blocks only wake when a neighbour ticks, and there is none left that does
+        if (g->live_count && g->parked_count == g->live_count)
+            return GRID_DEADLOCK;
+
+        if (detect_cycles && grid_cycle_step(g, &cycle))
+        {
+            const u32 period = g->ticks - cycle.ticks;
+            g->ticks += (max_ticks - g->ticks) / period * period; // the last tick still runs and returns
+            detect_cycles = false;
+        }
+
+        if (g->soonest_wake && grid_fast_forward(g, max_ticks))
+            return GRID_TICK_LIMIT;
+    }
+}
+
+grid_status run_grid(grid *g, u32 max_ticks)
+{
+    return grid_run(g, max_ticks, true);
+}
+
+bool rerun_grid(grid *g, grid_status *status)
+{
+    if (!history_restore(g))
+        return false;
+
+    *status = grid_run(g, g->history->max_ticks, false);
+    return true;
+}
+
+// neighbour the parked block at index n is blocked on, NULL if it is not parked
+static block *grid_waits_on(grid *g, u16 n, side *s)
+{
+    block *b = &g->blocks[n];
+    if (!b->parked)
+        return NULL;
+
+    *s = block_fetch(b, b->current_instruction)->side;
+    return grid_step_block(g, n % g->width, n / g->width, *s);
+}
+
+static void print_waiting_block(FILE *f, grid *g, u16 n)
+{
+    block *b = &g->blocks[n];
+    const decoded_instruction *d = block_fetch(b, b->current_instruction);
+
+    fprintf(f, "%u,%u pc %u %s %s", n % g->width, n / g->width, b->current_instruction, op_code_str(d->operation),
+            target_str(d->target));
+}
+
+/*
+    parked blocks and the neighbours they wait on form the wait-for graph, each block waits on at most one. prints its
+    cycles first, then every other block that waits, with what it waits on
+*/
+void print_deadlock(FILE *f, grid *g)
+{
+    const u16 total = g->width * g->height;
+    u8 visited[256] = {0}; // 1 while on the path being followed, 2 once done
+    bool in_cycle[256] = {0};
+    side s;
+
+    for (u16 n = 0; n < total; n++)
+    {
+        u16 at = n;
+        block *next;
+
+        while (!visited[at] && (next = grid_waits_on(g, at, &s)))
+        {
+            visited[at] = 1;
+            at = next - g->blocks;
+        }
+
+        if (visited[at] == 1) // came back to the path, at is on a cycle
+        {
+            fprintf(f, "cycle: ");
+            u16 c = at;
+            do
+            {
+                in_cycle[c] = true;
+                print_waiting_block(f, g, c);
+                fprintf(f, " -> ");
+                c = grid_waits_on(g, c, &s) - g->blocks;
+            } while (c != at);
+            fprintf(f, "%u,%u\n", at % g->width, at / g->width);
+        }
+
+        for (at = n; visited[at] == 1; at = grid_waits_on(g, at, &s) - g->blocks)
+            visited[at] = 2;
+    }
+
+    for (u16 n = 0; n < total; n++)
+    {
+        block *peer = grid_waits_on(g, n, &s);
+        if (!peer || in_cycle[n])
+            continue;
+
+        const u16 p = peer - g->blocks;
+        print_waiting_block(f, g, n);
+        fprintf(f, " waits on %u,%u%s\n", p % g->width, p / g->width,
+                !peer->bytecode ? ", which has no program" : peer->state_halted ? ", which has halted" : "");
+    }
+}
+
+// blocks the last run_grid left out since they cannot affect any output slot
+void print_pruned(FILE *f, const grid *g)
+{
+    for (u16 n = 0; n < g->width * g->height; n++)
+    {
+        const block *b = &g->blocks[n];
+        if (b->pruned)
+            fprintf(f, "pruned %u,%u, no output depends on it\n", n % g->width, n / g->width);
     }
 }